@@ -0,0 +1,445 @@
+//
+//  VoodooGPIOCoreTest.cpp
+//  VoodooGPIO
+//
+//  Checks the IOKit-free core against every platform table on the
+//  simulated PCH: pad group layout, pin and GPIO lookup tables, pad
+//  register locations, pending interrupt masks and debounce encoding, then
+//  runs the core interrupt dispatch, storm throttling and suspend/resume
+//  on every platform.
+//
+
+#include <time.h>
+
+#include "VoodooGPIOHost.hpp"
+
+static unsigned failures;
+
+#define CHECK(cond, ...)                                    \
+do {                                                        \
+    if (!(cond)) {                                          \
+        failures++;                                         \
+        printf("%s:%d: %s: ", __FILE__, __LINE__, #cond);   \
+        printf(__VA_ARGS__);                                \
+        printf("\n");                                       \
+    }                                                       \
+} while (0)
+
+/**
+ * Pad groups cover each community without gaps or overlap, fit a register
+ * and get increasing PAD_OWN register numbers.
+ */
+static void test_padgroups(VoodooGPIOHostController *ctl) {
+    const char *name = ctl->soc->name;
+
+    for (size_t i = 0; i < ctl->pctl.ncommunities; i++) {
+        const struct intel_community *community = &ctl->pctl.communities[i];
+        unsigned next = community->pin_base;
+        unsigned padown_num = 0;
+
+        CHECK(community->ngpps > 0, "%s community %zu has no pad groups", name, i);
+        for (size_t j = 0; j < community->ngpps; j++) {
+            const struct intel_padgroup *padgrp = &community->gpps[j];
+
+            CHECK(padgrp->base == next, "%s community %zu gpp %zu starts at %u, expected %u",
+                  name, i, j, padgrp->base, next);
+            CHECK(padgrp->size > 0 && padgrp->size <= 32, "%s community %zu gpp %zu size %u",
+                  name, i, j, padgrp->size);
+            CHECK(padgrp->padown_num == padown_num, "%s community %zu gpp %zu padown_num %u, expected %u",
+                  name, i, j, padgrp->padown_num, padown_num);
+            CHECK(padgrp->gpio_base != 0 || padgrp->base == 0, "%s community %zu gpp %zu gpio_base left at 0",
+                  name, i, j);
+            next = padgrp->base + padgrp->size;
+            padown_num += community->gpp_num_padown_regs ? community->gpp_num_padown_regs :
+                          DIV_ROUND_UP(padgrp->size * 4, 32);
+        }
+        CHECK(next == community->pin_base + community->npins, "%s community %zu pad groups end at %u",
+              name, i, next);
+    }
+}
+
+/**
+ * Every hardware pin maps back to its community, pad group and bit, and
+ * every GPIO offset either maps to the pad group that claims it or is a gap.
+ */
+static void test_pin_maps(VoodooGPIOHostController *ctl) {
+    const char *name = ctl->soc->name;
+    size_t mapped_gpios = 0, expected_gpios = 0, max_pin = 0;
+
+    for (size_t i = 0; i < ctl->pctl.ncommunities; i++) {
+        const struct intel_community *community = &ctl->pctl.communities[i];
+
+        if (community->pin_base + community->npins > max_pin)
+            max_pin = community->pin_base + community->npins;
+
+        for (size_t j = 0; j < community->ngpps; j++) {
+            const struct intel_padgroup *padgrp = &community->gpps[j];
+
+            for (unsigned k = 0; k < padgrp->size; k++) {
+                const struct intel_pin_map *map = &ctl->pctl.pin_map[padgrp->base + k];
+
+                CHECK(map->pin == padgrp->base + k && map->community == i && map->padgroup == j &&
+                      map->offset == k, "%s pin %u maps to %u/%u/%u/%u", name, padgrp->base + k,
+                      map->pin, map->community, map->padgroup, map->offset);
+                CHECK(intel_pin_map_padgroup(ctl->pctl.communities, ctl->pctl.pin_map, ctl->pctl.npin_map, community,
+                                             padgrp->base + k) == padgrp,
+                      "%s pin %u padgroup lookup", name, padgrp->base + k);
+
+                if (padgrp->gpio_base < 0)
+                    continue;
+
+                map = &ctl->pctl.gpio_map[padgrp->gpio_base + k];
+                CHECK(map->pin == padgrp->base + k && map->community == i,
+                      "%s GPIO %u maps to pin %u", name, padgrp->gpio_base + k, map->pin);
+            }
+            if (padgrp->gpio_base >= 0)
+                expected_gpios += padgrp->size;
+        }
+
+        /* Pins of one community never resolve to a pad group of another */
+        if (i > 0) {
+            CHECK(!intel_pin_map_padgroup(ctl->pctl.communities, ctl->pctl.pin_map, ctl->pctl.npin_map, community,
+                                          ctl->pctl.communities[0].pin_base),
+                  "%s pin %u found in community %zu", name, ctl->pctl.communities[0].pin_base, i);
+        }
+    }
+
+    CHECK(ctl->pctl.npin_map == max_pin, "%s pin map has %zu entries, expected %zu", name, ctl->pctl.npin_map, max_pin);
+    CHECK(!intel_pin_map_padgroup(ctl->pctl.communities, ctl->pctl.pin_map, ctl->pctl.npin_map, &ctl->pctl.communities[0],
+                                  (unsigned)ctl->pctl.npin_map),
+          "%s pin past the map has a pad group", name);
+
+    for (size_t gpio = 0; gpio < ctl->pctl.ngpio_map; gpio++) {
+        if (ctl->pctl.gpio_map[gpio].community != INTEL_PIN_MAP_NONE)
+            mapped_gpios++;
+    }
+    CHECK(mapped_gpios == expected_gpios, "%s maps %zu GPIOs, expected %zu", name, mapped_gpios, expected_gpios);
+}
+
+/**
+ * The precomputed register offsets address the pin's own registers in the
+ * simulated community.
+ */
+static void test_pad_descs(VoodooGPIOHostController *ctl) {
+    const char *name = ctl->soc->name;
+    VoodooGPIOSimulatedPCH *pch = &ctl->pch;
+
+    for (unsigned pin = 0; pin < ctl->pctl.npin_map; pin++) {
+        const struct intel_pin_map *map = &ctl->pctl.pin_map[pin];
+        const struct intel_pad_desc *desc = &ctl->pctl.pad_descs[pin];
+
+        if (map->community == INTEL_PIN_MAP_NONE)
+            continue;
+
+        const struct intel_community *community = &ctl->pctl.communities[map->community];
+        unsigned padno = pin - community->pin_base;
+        unsigned stride = community->features & PINCTRL_FEATURE_DEBOUNCE ? 16 : 8;
+        uint32_t value = 0x40000000 | pin << 2;
+
+        CHECK(desc->padcfg == kSimPadBar + padno * stride, "%s pin %u PADCFG0 at %#x", name, pin, desc->padcfg);
+        CHECK(!!(desc->flags & INTEL_PAD_HAS_PADCFG2) == (stride == 16), "%s pin %u PADCFG2 flag", name, pin);
+
+        /* PADCFG0 and, if present, PADCFG2 land on the pad's own registers */
+        pch->write32(value, community->regs + desc->padcfg);
+        CHECK(pch->peek(map->community, kSimPadBar + padno * stride) == value,
+              "%s pin %u PADCFG0 write went elsewhere", name, pin);
+        if (desc->flags & INTEL_PAD_HAS_PADCFG2) {
+            pch->write32(value, community->regs + desc->padcfg + PADCFG2);
+            CHECK(pch->peek(map->community, kSimPadBar + padno * stride + PADCFG2) == value,
+                  "%s pin %u PADCFG2 write went elsewhere", name, pin);
+        }
+
+        CHECK(!!(desc->flags & INTEL_PAD_HAS_PADGROUP) == (map->padgroup != INTEL_PIN_MAP_NONE),
+              "%s pin %u pad group flag", name, pin);
+        if (!(desc->flags & INTEL_PAD_HAS_PADGROUP))
+            continue;
+
+        const struct intel_padgroup *padgrp = &community->gpps[map->padgroup];
+
+        CHECK(desc->mask == BIT(pin - padgrp->base), "%s pin %u mask %#x", name, pin, desc->mask);
+        CHECK(desc->ie_reg == community->ie_offset + padgrp->reg_num * 4, "%s pin %u GPI_IE at %#x",
+              name, pin, desc->ie_reg);
+
+        /* GPI_IS of the pin latches through the simulated pin side */
+        pch->raise(map->community, padgrp->reg_num, desc->mask);
+        CHECK(pch->read32(community->regs + desc->is_reg) & desc->mask, "%s pin %u GPI_IS at %#x",
+              name, pin, desc->is_reg);
+        pch->write32(desc->mask, community->regs + desc->is_reg);
+        CHECK(!(pch->read32(community->regs + desc->is_reg) & desc->mask), "%s pin %u GPI_IS not cleared",
+              name, pin);
+
+        CHECK(desc->hostown == community->hostown_offset + padgrp->reg_num * 4, "%s pin %u HOSTSW_OWN at %#x",
+              name, pin, desc->hostown);
+        CHECK(pch->read32(community->regs + desc->hostown) & desc->mask, "%s pin %u HOSTSW_OWN out of reset",
+              name, pin);
+        CHECK(desc->padcfglock == community->padcfglock_offset + padgrp->reg_num * 8, "%s pin %u PADCFGLOCK at %#x",
+              name, pin, desc->padcfglock);
+
+        /* PAD_OWN is read-only from the host; firmware sets it */
+        uint32_t padown = PADOWN_MASK(pin - padgrp->base);
+        pch->poke(map->community, desc->padown, padown);
+        CHECK((pch->read32(community->regs + desc->padown) >> desc->padown_shift & 0xf) == 0xf,
+              "%s pin %u PAD_OWN at %#x shift %u", name, pin, desc->padown, desc->padown_shift);
+        pch->poke(map->community, desc->padown, 0);
+    }
+}
+
+/**
+ * Pending masks only report enabled, registered pins, and the gated mask
+ * leaves filter pins alone. Level pins keep latching until deasserted.
+ */
+static void test_pending(VoodooGPIOHostController *ctl) {
+    const char *name = ctl->soc->name;
+    VoodooGPIOSimulatedPCH *pch = &ctl->pch;
+    struct intel_community *community = &ctl->pctl.communities[ctl->pctl.ncommunities - 1];
+    struct intel_padgroup_state *state = &community->gpp_state[0];
+    unsigned reg_num = community->gpps[0].reg_num;
+    uintptr_t is_reg = community->regs + GPI_IS + reg_num * 4;
+    uint32_t is;
+
+    state->registered = 0x0000000f;
+    state->ie = 0x00000017;
+    state->filter = 0x00000002;
+
+    pch->raise((unsigned)ctl->pctl.ncommunities - 1, reg_num, 0x000000ff);
+    is = pch->read32(is_reg);
+    CHECK(intel_padgroup_pending(state, is) == 0x7, "%s pending %#x", name, intel_padgroup_pending(state, is));
+    CHECK(intel_padgroup_pending_gated(state, is) == 0x5, "%s gated pending %#x", name,
+          intel_padgroup_pending_gated(state, is));
+
+    pch->write32(is, is_reg);
+    CHECK(intel_padgroup_pending(state, pch->read32(is_reg)) == 0, "%s edges still pending", name);
+
+    pch->setLevel((unsigned)ctl->pctl.ncommunities - 1, reg_num, 0x4, true);
+    pch->write32(0xffffffff, is_reg);
+    CHECK(intel_padgroup_pending_gated(state, pch->read32(is_reg)) == 0x4, "%s asserted level not pending", name);
+    pch->setLevel((unsigned)ctl->pctl.ncommunities - 1, reg_num, 0x4, false);
+    pch->write32(0xffffffff, is_reg);
+    CHECK(intel_padgroup_pending(state, pch->read32(is_reg)) == 0, "%s deasserted level still pending", name);
+
+    state->registered = state->ie = state->filter = 0;
+}
+
+static void host_handler(OSObject *owner, void *refcon, IOService *nub, int source) {
+    (*(unsigned *)refcon)++;
+}
+
+/**
+ * Claim @pin for a counting handler, set it to rising edge and unmask it,
+ * as registerInterrupt(), setInterruptTypeForPin() and enableInterrupt() do.
+ */
+static bool host_claim(VoodooGPIOHostController *ctl, unsigned pin, unsigned *count, bool filter) {
+    struct intel_pin_irq desc;
+
+    memset(&desc, 0, sizeof(desc));
+    desc.mode = INTEL_PIN_IRQ_HANDLER;
+    desc.handler = host_handler;
+    desc.refcon = count;
+
+    if (!intel_gpio_claim_irq(&ctl->pctl, pin, reinterpret_cast<OSObject *>(ctl), &desc, filter))
+        return false;
+    intel_gpio_store_irq_type(&ctl->pctl, pin, IRQ_TYPE_EDGE_RISING);
+    if (!intel_gpio_irq_set_type(&ctl->pctl, pin, IRQ_TYPE_EDGE_RISING))
+        return false;
+    intel_gpio_irq_enable(&ctl->pctl, pin);
+    return true;
+}
+
+/**
+ * Latch @pin on the pin side of the simulated PCH.
+ */
+static void host_raise(VoodooGPIOHostController *ctl, unsigned pin) {
+    const struct intel_pin_map *map = &ctl->pctl.pin_map[pin];
+    const struct intel_community *community = &ctl->pctl.communities[map->community];
+
+    ctl->pch.raise(map->community, community->gpps[map->padgroup].reg_num, ctl->pctl.pad_descs[pin].mask);
+}
+
+static uint32_t host_ie(VoodooGPIOHostController *ctl, unsigned pin) {
+    const struct intel_community *community = &ctl->pctl.communities[ctl->pctl.pin_map[pin].community];
+
+    return ctl->pch.read32(community->regs + ctl->pctl.pad_descs[pin].ie_reg) & ctl->pctl.pad_descs[pin].mask;
+}
+
+static uint32_t host_is(VoodooGPIOHostController *ctl, unsigned pin) {
+    const struct intel_community *community = &ctl->pctl.communities[ctl->pctl.pin_map[pin].community];
+
+    return ctl->pch.read32(community->regs + ctl->pctl.pad_descs[pin].is_reg) & ctl->pctl.pad_descs[pin].mask;
+}
+
+/**
+ * Filter pins are dispatched by intel_gpio_irq_filter(), everything else is
+ * deferred to intel_gpio_irq_handler(), and both acknowledge what they ran.
+ */
+static void test_dispatch(VoodooGPIOHostController *ctl) {
+    const char *name = ctl->soc->name;
+    struct intel_pinctrl *pctl = &ctl->pctl;
+    unsigned pin = pctl->communities[0].gpps[0].base;
+    unsigned fast = pin + 1;
+    unsigned count = 0, fast_count = 0;
+
+    CHECK(host_claim(ctl, pin, &count, false), "%s pin %u claim", name, pin);
+    CHECK(host_claim(ctl, fast, &fast_count, true), "%s pin %u filter claim", name, fast);
+    CHECK(!host_claim(ctl, pin, &count, false), "%s pin %u claimed twice", name, pin);
+    CHECK(host_ie(ctl, pin) && host_ie(ctl, fast), "%s pins not unmasked", name);
+    CHECK(!intel_pinctrl_idle(pctl), "%s idle with pins registered", name);
+
+    host_raise(ctl, pin);
+    host_raise(ctl, fast);
+    CHECK(intel_gpio_irq_filter(pctl), "%s filter did not defer a work loop pin", name);
+    CHECK(fast_count == 1 && count == 0, "%s filter dispatched %u/%u", name, fast_count, count);
+    CHECK(!host_is(ctl, fast) && host_is(ctl, pin), "%s filter acknowledged the wrong pins", name);
+
+    CHECK(intel_gpio_irq_handler(pctl) == 0, "%s handler armed the storm timer", name);
+    CHECK(fast_count == 1 && count == 1, "%s handler dispatched %u/%u", name, fast_count, count);
+    CHECK(!host_is(ctl, pin), "%s pin %u not acknowledged", name, pin);
+
+    host_raise(ctl, fast);
+    CHECK(!intel_gpio_irq_filter(pctl), "%s filter deferred with only filter pins pending", name);
+    CHECK(fast_count == 2, "%s filter pin dispatched %u times", name, fast_count);
+
+    CHECK(!intel_gpio_release_irq(pctl, pin) && !intel_gpio_release_irq(pctl, fast), "%s released a ring", name);
+    CHECK(!host_ie(ctl, pin) && !host_ie(ctl, fast), "%s released pins left unmasked", name);
+    CHECK(intel_pinctrl_idle(pctl) && !pctl->nfilter_pins, "%s not idle after release", name);
+
+    host_raise(ctl, pin);
+    CHECK(intel_gpio_irq_filter(pctl), "%s filter with no filter pins", name);
+    intel_gpio_irq_handler(pctl);
+    CHECK(count == 1, "%s released pin dispatched", name);
+    ctl->pch.write32(0xffffffff, pctl->communities[0].regs + pctl->pad_descs[pin].is_reg);
+}
+
+/**
+ * A pin firing past its storm limit is masked until its backoff expires,
+ * then unmasked with its window restarted.
+ */
+static void test_storm(VoodooGPIOHostController *ctl) {
+    const char *name = ctl->soc->name;
+    struct intel_pinctrl *pctl = &ctl->pctl;
+    unsigned pin = pctl->communities[0].gpps[0].base;
+    unsigned count = 0;
+    uint64_t storms = pctl->stats.storm_events, deadline = 0;
+    struct timespec backoff = { 0, 2 * 1000000 };
+
+    /* One interrupt per window */
+    intel_gpio_storm_setup(pctl, 1000 / kStormWindowMS, 1000 / kStormWindowMS, 1);
+    CHECK(host_claim(ctl, pin, &count, false), "%s pin %u claim", name, pin);
+
+    for (unsigned i = 0; i < 3; i++) {
+        host_raise(ctl, pin);
+        intel_gpio_irq_filter(pctl);
+        uint64_t next = intel_gpio_irq_handler(pctl);
+        if (next)
+            deadline = next;
+    }
+    CHECK(count == 2, "%s storming pin dispatched %u times", name, count);
+    CHECK(pctl->stats.storm_events == storms + 1, "%s %llu storms", name,
+          (unsigned long long)(pctl->stats.storm_events - storms));
+    CHECK(!host_ie(ctl, pin) && deadline, "%s storming pin not throttled", name);
+
+    nanosleep(&backoff, NULL);
+    CHECK(intel_gpio_storm_rearm(pctl) == 0, "%s throttled pin not due", name);
+    CHECK(host_ie(ctl, pin), "%s throttled pin not unmasked", name);
+
+    host_raise(ctl, pin);
+    intel_gpio_irq_filter(pctl);
+    intel_gpio_irq_handler(pctl);
+    CHECK(count == 3, "%s unthrottled pin dispatched %u times", name, count);
+
+    intel_gpio_release_irq(pctl, pin);
+    intel_gpio_storm_setup(pctl, kStormDefaultRate, kStormDefaultRate, kStormDefaultBackoffMS);
+}
+
+/**
+ * Suspend masks registered pins, and resume restores pads the firmware
+ * clobbered and unmasks them again, right away or once deferred.
+ */
+static void test_suspend_resume(VoodooGPIOHostController *ctl) {
+    const char *name = ctl->soc->name;
+    struct intel_pinctrl *pctl = &ctl->pctl;
+    unsigned pin = pctl->communities[0].gpps[0].base;
+    uintptr_t padcfg0 = intel_get_padcfg(pctl, pin, PADCFG0);
+    uint64_t wakes = pctl->stats.wakes;
+    unsigned count = 0;
+    uint32_t value;
+
+    CHECK(host_claim(ctl, pin, &count, false), "%s pin %u claim", name, pin);
+    value = ctl->pch.read32(padcfg0);
+
+    for (int defer = 0; defer < 2; defer++) {
+        intel_pinctrl_suspend(pctl);
+        CHECK(!host_ie(ctl, pin), "%s pin %u unmasked over sleep", name, pin);
+
+        /* Firmware resets the pad while we are asleep */
+        ctl->pch.write32(0, padcfg0);
+
+        CHECK(intel_pinctrl_resume(pctl, defer) == (defer ? 0 : 1), "%s %s wake rewrote %u registers", name,
+              defer ? "deferred" : "full", pctl->stats.last_wake_clobbered);
+        if (defer) {
+            CHECK(!host_ie(ctl, pin) && ctl->pch.read32(padcfg0) == 0, "%s pin %u re-armed early", name, pin);
+            CHECK(intel_pinctrl_rearm_pending(pctl) == 1, "%s deferred re-arm", name);
+        }
+        CHECK(ctl->pch.read32(padcfg0) == value, "%s pin %u PADCFG0 %#x, expected %#x", name, pin,
+              ctl->pch.read32(padcfg0), value);
+        CHECK(host_ie(ctl, pin), "%s pin %u masked after wake", name, pin);
+    }
+    CHECK(pctl->stats.wakes == wakes + 2, "%s wakes not counted", name);
+
+    intel_gpio_release_irq(pctl, pin);
+}
+
+static void test_debounce(void) {
+    static const struct {
+        uint32_t us;
+        uint32_t value;
+    } cases[] = {
+        { 0, 0 },
+        { 1, 3 << PADCFG2_DEBOUNCE_SHIFT | PADCFG2_DEBEN },          /* Shortest period, 250 us */
+        { 250, 3 << PADCFG2_DEBOUNCE_SHIFT | PADCFG2_DEBEN },
+        { 375, 4 << PADCFG2_DEBOUNCE_SHIFT | PADCFG2_DEBEN },        /* Halfway rounds up */
+        { 374, 3 << PADCFG2_DEBOUNCE_SHIFT | PADCFG2_DEBEN },
+        { 500, 4 << PADCFG2_DEBOUNCE_SHIFT | PADCFG2_DEBEN },
+        { 1000, 5 << PADCFG2_DEBOUNCE_SHIFT | PADCFG2_DEBEN },
+        { 1024000, 15 << PADCFG2_DEBOUNCE_SHIFT | PADCFG2_DEBEN },   /* Longest period */
+    };
+    uint32_t value;
+
+    for (size_t i = 0; i < ARRAY_SIZE(cases); i++) {
+        CHECK(intel_debounce_encode(cases[i].us, &value), "debounce %u us rejected", cases[i].us);
+        CHECK(value == cases[i].value, "debounce %u us encoded %#x, expected %#x", cases[i].us, value,
+              cases[i].value);
+        CHECK(!(value & ~(PADCFG2_DEBEN | PADCFG2_DEBOUNCE_MASK)), "debounce %u us sets %#x", cases[i].us, value);
+    }
+
+    CHECK(!intel_debounce_encode(1024001, &value), "debounce past the longest period accepted");
+    CHECK(!intel_debounce_encode(0xffffffff, &value), "debounce 0xffffffff us accepted");
+}
+
+int main() {
+    for (size_t i = 0; i < ARRAY_SIZE(host_platforms); i++) {
+        VoodooGPIOHostController ctl;
+
+        if (!ctl.init(host_platforms[i].soc, host_platforms[i].revid)) {
+            printf("%s: probe failed\n", host_platforms[i].soc->name);
+            failures++;
+            continue;
+        }
+
+        test_padgroups(&ctl);
+        test_pin_maps(&ctl);
+        test_pad_descs(&ctl);
+        test_pending(&ctl);
+        test_dispatch(&ctl);
+        test_storm(&ctl);
+        test_suspend_resume(&ctl);
+        printf("%s: %zu pins, %zu pad groups, %zu GPIOs checked\n", ctl.soc->name, ctl.pctl.npin_map,
+               ctl.pctl.total_gpps, ctl.pctl.ngpio_map);
+    }
+    test_debounce();
+
+    if (failures) {
+        printf("%u checks failed\n", failures);
+        return 1;
+    }
+    return 0;
+}
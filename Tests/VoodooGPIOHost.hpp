@@ -0,0 +1,69 @@
+//
+//  VoodooGPIOHost.hpp
+//  VoodooGPIO
+//
+//  Host-side stand-in for the probe path of the core driver: lays out a
+//  simulated PCH for a platform table and probes it into a controller
+//  through the core, the way VoodooGPIO::start() does.
+//
+
+#ifndef VoodooGPIOHost_h
+#define VoodooGPIOHost_h
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "VoodooGPIOCore.hpp"
+#include "VoodooGPIORegisters.hpp"
+#include "linuxirq.h"
+#include "Simulation/VoodooGPIOSimulatedPCH.hpp"
+
+extern const struct intel_pinctrl_soc_data sptlp_soc_data;
+extern const struct intel_pinctrl_soc_data spth_soc_data;
+extern const struct intel_pinctrl_soc_data cnllp_soc_data;
+extern const struct intel_pinctrl_soc_data cnlh_soc_data;
+
+static const struct {
+    const struct intel_pinctrl_soc_data *soc;
+    uint32_t revid;
+} host_platforms[] = {
+    { &sptlp_soc_data, 0x00 },
+    { &spth_soc_data, 0x00 },
+    { &cnllp_soc_data, 0x94 },
+    { &cnlh_soc_data, 0x94 },
+};
+
+/**
+ * struct VoodooGPIOHostController - A probed platform on a simulated PCH
+ * @soc: Platform table
+ * @pch: Register backend the communities are mapped to
+ * @pctl: Controller state, as the driver holds it
+ */
+struct VoodooGPIOHostController {
+    const struct intel_pinctrl_soc_data *soc;
+    VoodooGPIOSimulatedPCH pch;
+    struct intel_pinctrl pctl;
+
+    VoodooGPIOHostController() : soc(NULL) {
+        memset(&pctl, 0, sizeof(pctl));
+    }
+
+    ~VoodooGPIOHostController() {
+        pch.detach(&pctl);
+    }
+
+    /**
+     * Probe @soc on a fresh simulated PCH reporting @revid, with the
+     * default storm limits.
+     */
+    bool init(const struct intel_pinctrl_soc_data *platform, uint32_t revid) {
+        soc = platform;
+        if (!pch.attach(&pctl, soc, revid))
+            return false;
+        intel_gpio_storm_setup(&pctl, kStormDefaultRate, kStormDefaultRate, kStormDefaultBackoffMS);
+        return true;
+    }
+};
+
+#endif /* VoodooGPIOHost_h */
@@ -0,0 +1,338 @@
+//
+//  VoodooGPIOReplayTest.cpp
+//  VoodooGPIO
+//
+//  Replays a recorded trace from Tests/Fixtures through the core on the
+//  simulated PCH, with the same steps and expectations as the ReplayTrace
+//  property of a debug build; see VoodooGPIOReplay.hpp for the format.
+//
+//  Usage: VoodooGPIOReplayTest trace.plist
+//
+
+#include <string>
+#include <vector>
+
+#include "VoodooGPIOHost.hpp"
+#include "Simulation/VoodooGPIOTraceReplay.hpp"
+
+/**
+ * struct plist_node - Value of an XML property list
+ * @type: Element name: dict, array, integer, string, true or false
+ * @text: Contents of a string
+ * @number: Value of an integer
+ * @keys: Keys of a dict, one per child
+ * @children: Values of a dict or array
+ */
+struct plist_node {
+    std::string type;
+    std::string text;
+    long long number;
+    std::vector<std::string> keys;
+    std::vector<plist_node> children;
+
+    plist_node() : number(0) {}
+
+    const plist_node *get(const char *key) const {
+        for (size_t i = 0; i < keys.size(); i++) {
+            if (keys[i] == key)
+                return &children[i];
+        }
+        return NULL;
+    }
+
+    bool getNumber(const char *key, uint32_t *value) const {
+        const plist_node *node = get(key);
+        if (!node || node->type != "integer")
+            return false;
+        *value = (uint32_t)node->number;
+        return true;
+    }
+};
+
+/**
+ * Just enough of an XML property list reader for the fixtures: no
+ * attributes on values, no entities, no data or date values.
+ */
+class plist_reader {
+ public:
+    explicit plist_reader(const std::string &xml) : s(xml), pos(0) {}
+
+    bool read(plist_node *root) {
+        if (!skipTo("<plist"))
+            return false;
+        pos = s.find('>', pos);
+        if (pos == std::string::npos)
+            return false;
+        pos++;
+        return value(root);
+    }
+
+ private:
+    const std::string &s;
+    size_t pos;
+
+    bool skipTo(const char *what) {
+        pos = s.find(what, pos);
+        return pos != std::string::npos;
+    }
+
+    /* Next element name, skipping whitespace, comments and declarations */
+    bool tag(std::string *name) {
+        for (;;) {
+            pos = s.find('<', pos);
+            if (pos == std::string::npos)
+                return false;
+            if (s.compare(pos, 4, "<!--") == 0) {
+                if (!skipTo("-->"))
+                    return false;
+                continue;
+            }
+            if (s[pos + 1] == '?' || s[pos + 1] == '!') {
+                pos = s.find('>', pos);
+                if (pos == std::string::npos)
+                    return false;
+                continue;
+            }
+            break;
+        }
+
+        size_t end = s.find('>', pos);
+        if (end == std::string::npos)
+            return false;
+        *name = s.substr(pos + 1, end - pos - 1);
+        pos = end + 1;
+        return true;
+    }
+
+    bool text(const std::string &name, std::string *out) {
+        std::string close = "</" + name + ">";
+        size_t end = s.find(close, pos);
+        if (end == std::string::npos)
+            return false;
+        *out = s.substr(pos, end - pos);
+        pos = end + close.size();
+        return true;
+    }
+
+    bool value(plist_node *node) {
+        std::string name;
+
+        if (!tag(&name))
+            return false;
+        return valueOf(name, node);
+    }
+
+    bool valueOf(const std::string &name, plist_node *node) {
+        if (name == "true/" || name == "false/") {
+            node->type = name.substr(0, name.size() - 1);
+            return true;
+        }
+
+        node->type = name;
+        if (name == "integer") {
+            std::string str;
+            if (!text(name, &str))
+                return false;
+            node->number = strtoll(str.c_str(), NULL, 0);
+            return true;
+        }
+        if (name == "string")
+            return text(name, &node->text);
+        if (name == "dict/" || name == "array/") {
+            node->type = name.substr(0, name.size() - 1);
+            return true;
+        }
+        if (name != "dict" && name != "array")
+            return false;
+
+        for (;;) {
+            std::string child;
+
+            if (!tag(&child))
+                return false;
+            if (child == "/" + name)
+                return true;
+
+            if (name == "dict") {
+                std::string key;
+                if (child != "key" || !text(child, &key) || !tag(&child))
+                    return false;
+                node->keys.push_back(key);
+            }
+            node->children.push_back(plist_node());
+            if (!valueOf(child, &node->children.back()))
+                return false;
+        }
+    }
+};
+
+/**
+ * Turn a step dictionary into @step, as VoodooGPIOReplay::parseStep() does.
+ */
+static bool parse_step(const plist_node *dict, struct intel_replay_step *step) {
+    const plist_node *op = dict->get("Op");
+    const plist_node *flag;
+
+    if (dict->type != "dict" || !op || op->type != "string")
+        return false;
+
+    memset(step, 0, sizeof(*step));
+    step->op = VoodooGPIOTraceReplay::parseOp(op->text.c_str());
+
+    switch (step->op) {
+        case kReplayOpRegister:
+            flag = dict->get("Filter");
+            step->flag = flag && flag->type == "true";
+            step->has_type = dict->getNumber("Type", &step->type);
+            return dict->getNumber("Pin", &step->pin);
+        case kReplayOpUnregister:
+        case kReplayOpEnable:
+        case kReplayOpDisable:
+            return dict->getNumber("Pin", &step->pin);
+        case kReplayOpLevel:
+            flag = dict->get("Asserted");
+            if (!flag || (flag->type != "true" && flag->type != "false"))
+                return false;
+            step->flag = flag->type == "true";
+            /* Fall through */
+        case kReplayOpRaise:
+            return dict->getNumber("Community", &step->community) && dict->getNumber("Reg", &step->reg) &&
+                   dict->getNumber("Bits", &step->value);
+        case kReplayOpRead:
+        case kReplayOpWrite:
+            return dict->getNumber("Community", &step->community) && dict->getNumber("Offset", &step->offset) &&
+                   dict->getNumber("Value", &step->value);
+        case kReplayOpDelay:
+            return dict->getNumber("MS", &step->value);
+        case kReplayOpInterrupt:
+        case kReplayOpSleep:
+        case kReplayOpWake:
+            return true;
+        default:
+            return false;
+    }
+}
+
+static bool read_file(const char *path, std::string *contents) {
+    FILE *file = fopen(path, "rb");
+    char buf[4096];
+    size_t n;
+
+    if (!file)
+        return false;
+    while ((n = fread(buf, 1, sizeof(buf), file)) > 0)
+        contents->append(buf, n);
+    fclose(file);
+    return true;
+}
+
+int main(int argc, char **argv) {
+    const struct intel_pinctrl_soc_data *soc = NULL;
+    uint32_t revid = 0, storm_rate = 0, counter_rate = 0, backoff_ms = 0, value;
+    VoodooGPIOTraceReplay replay;
+    const plist_node *platform, *steps, *expected;
+    plist_node trace;
+    std::string xml;
+    unsigned failures = 0;
+
+    if (argc < 2) {
+        printf("usage: %s trace.plist\n", argv[0]);
+        return 2;
+    }
+    if (!read_file(argv[1], &xml) || !plist_reader(xml).read(&trace) || trace.type != "dict") {
+        printf("%s: not a property list\n", argv[1]);
+        return 1;
+    }
+
+    platform = trace.get("Platform");
+    steps = trace.get("Steps");
+    if (!platform || !steps || steps->type != "array") {
+        printf("%s: no Platform or Steps\n", argv[1]);
+        return 1;
+    }
+
+    for (size_t i = 0; i < ARRAY_SIZE(host_platforms); i++) {
+        if (platform->text == host_platforms[i].soc->name) {
+            soc = host_platforms[i].soc;
+            revid = host_platforms[i].revid;
+        }
+    }
+    if (!soc) {
+        printf("%s: unknown platform %s\n", argv[1], platform->text.c_str());
+        return 1;
+    }
+
+    trace.getNumber("StormRate", &storm_rate);
+    trace.getNumber("CounterStormRate", &counter_rate);
+    trace.getNumber("StormBackoffMS", &backoff_ms);
+
+    if (!replay.start(soc, revid, storm_rate, counter_rate, backoff_ms)) {
+        printf("%s: probe failed\n", soc->name);
+        return 1;
+    }
+
+    for (size_t i = 0; i < steps->children.size(); i++) {
+        struct intel_replay_step step;
+
+        if (!parse_step(&steps->children[i], &step) || !replay.runStep(&step)) {
+            printf("%s: malformed step %zu\n", argv[1], i);
+            return 1;
+        }
+    }
+
+    printf("%s: %zu steps, %zu handler calls, %llu interrupts, %llu reads, %llu writes, %llu storms\n",
+           argv[1], steps->children.size(), replay.ncalls, (unsigned long long)replay.pctl.stats.interrupts,
+           (unsigned long long)replay.pch.reads, (unsigned long long)replay.pch.writes,
+           (unsigned long long)replay.pctl.stats.storm_events);
+
+    expected = trace.get("ExpectHandlers");
+    if (expected) {
+        bool match = expected->children.size() == replay.ncalls;
+
+        for (size_t i = 0; match && i < replay.ncalls; i++)
+            match = expected->children[i].number == replay.calls[i];
+        if (!match) {
+            printf("handlers called:");
+            for (size_t i = 0; i < replay.ncalls; i++)
+                printf(" %u", replay.calls[i]);
+            printf("\n");
+            failures++;
+        }
+    }
+    if (trace.getNumber("ExpectMMIOReads", &value) && value != replay.pch.reads) {
+        printf("expected %u reads\n", value);
+        failures++;
+    }
+    if (trace.getNumber("ExpectMMIOWrites", &value) && value != replay.pch.writes) {
+        printf("expected %u writes\n", value);
+        failures++;
+    }
+    if (trace.getNumber("ExpectStormEvents", &value) && value != replay.pctl.stats.storm_events) {
+        printf("expected %u storms\n", value);
+        failures++;
+    }
+
+    expected = trace.get("ExpectRegisters");
+    for (size_t i = 0; expected && i < expected->children.size(); i++) {
+        const plist_node *reg = &expected->children[i];
+        uint32_t community, offset;
+
+        if (!reg->getNumber("Community", &community) || !reg->getNumber("Offset", &offset) ||
+            !reg->getNumber("Value", &value)) {
+            printf("malformed ExpectRegisters entry %zu\n", i);
+            failures++;
+            continue;
+        }
+        if (replay.readRegister(community, offset) != value) {
+            printf("community %u offset %#x is %#x, expected %#x\n", community, offset,
+                   replay.readRegister(community, offset), value);
+            failures++;
+        }
+    }
+
+    if (failures) {
+        printf("%u expectations not met\n", failures);
+        return 1;
+    }
+    return 0;
+}
@@ -8,19 +8,28 @@
 
 #include "VoodooGPIOCannonLakeH.hpp"
 
+#ifndef VOODOOGPIO_HOST
 OSDefineMetaClassAndStructors(VoodooGPIOCannonLakeH, VoodooGPIO);
+#endif
 
+const struct intel_pinctrl_soc_data cnlh_soc_data = {
+    .name = "CannonLake-H",
+    .pins = cnlh_pins,
+    .npins = ARRAY_SIZE(cnlh_pins),
+    .groups = cnlh_groups,
+    .ngroups = ARRAY_SIZE(cnlh_groups),
+    .functions = cnlh_functions,
+    .nfunctions = ARRAY_SIZE(cnlh_functions),
+    .communities = cnlh_communities,
+    .ncommunities = ARRAY_SIZE(cnlh_communities),
+};
+
+#ifndef VOODOOGPIO_HOST
 bool VoodooGPIOCannonLakeH::start(IOService *provider) {
-    this->pins = cnlh_pins;
-    this->npins = ARRAY_SIZE(cnlh_pins);
-    this->groups = cnlh_groups;
-    this->ngroups = ARRAY_SIZE(cnlh_groups);
-    this->functions = cnlh_functions;
-    this->nfunctions = ARRAY_SIZE(cnlh_functions);
-    this->communities = cnlh_communities;
-    this->ncommunities = ARRAY_SIZE(cnlh_communities);
+    intel_pinctrl_set_soc_data(&cnlh_soc_data);
 
     IOLog("%s::Loading GPIO Data for CannonLake-H\n", getName());
 
     return VoodooGPIO::start(provider);
 }
+#endif
@@ -6,7 +6,11 @@
 //  Copyright © 2018 Alexandre Daoud. All rights reserved.
 //
 
+#ifdef VOODOOGPIO_HOST
+#include "../VoodooGPIOCore.hpp"
+#else
 #include "../VoodooGPIO.hpp"
+#endif
 
 #ifndef VoodooGPIOCannonLakeH_h
 #define VoodooGPIOCannonLakeH_h
@@ -447,10 +451,14 @@ static struct intel_community cnlh_communities[] = {
     CNLH_COMMUNITY(3, 249, 298, cnlh_community4_gpps),
 };
 
+extern const struct intel_pinctrl_soc_data cnlh_soc_data;
+
+#ifndef VOODOOGPIO_HOST
 class VoodooGPIOCannonLakeH : public VoodooGPIO {
     OSDeclareDefaultStructors(VoodooGPIOCannonLakeH);
 
     bool start(IOService *provider) override;
 };
+#endif
 
 #endif /* VoodooGPIOCannonLakeH_h */
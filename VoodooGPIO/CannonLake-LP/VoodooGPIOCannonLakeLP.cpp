@@ -8,19 +8,28 @@
 
 #include "VoodooGPIOCannonLakeLP.hpp"
 
+#ifndef VOODOOGPIO_HOST
 OSDefineMetaClassAndStructors(VoodooGPIOCannonLakeLP, VoodooGPIO);
+#endif
 
+const struct intel_pinctrl_soc_data cnllp_soc_data = {
+    .name = "CannonLake-LP",
+    .pins = cnllp_pins,
+    .npins = ARRAY_SIZE(cnllp_pins),
+    .groups = cnllp_groups,
+    .ngroups = ARRAY_SIZE(cnllp_groups),
+    .functions = cnllp_functions,
+    .nfunctions = ARRAY_SIZE(cnllp_functions),
+    .communities = cnllp_communities,
+    .ncommunities = ARRAY_SIZE(cnllp_communities),
+};
+
+#ifndef VOODOOGPIO_HOST
 bool VoodooGPIOCannonLakeLP::start(IOService *provider) {
-    this->pins = cnllp_pins;
-    this->npins = ARRAY_SIZE(cnllp_pins);
-    this->groups = cnllp_groups;
-    this->ngroups = ARRAY_SIZE(cnllp_groups);
-    this->functions = cnllp_functions;
-    this->nfunctions = ARRAY_SIZE(cnllp_functions);
-    this->communities = cnllp_communities;
-    this->ncommunities = ARRAY_SIZE(cnllp_communities);
+    intel_pinctrl_set_soc_data(&cnllp_soc_data);
 
     IOLog("%s::Loading GPIO Data for CannonLake-LP\n", getName());
 
     return VoodooGPIO::start(provider);
 }
+#endif
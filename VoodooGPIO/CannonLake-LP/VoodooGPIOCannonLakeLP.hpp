@@ -6,7 +6,11 @@
 //  Copyright © 2018 Alexandre Daoud. All rights reserved.
 //
 
+#ifdef VOODOOGPIO_HOST
+#include "../VoodooGPIOCore.hpp"
+#else
 #include "../VoodooGPIO.hpp"
+#endif
 
 #ifndef VoodooGPIOCannonLakeLP_h
 #define VoodooGPIOCannonLakeLP_h
@@ -391,10 +395,14 @@ static struct intel_community cnllp_communities[] = {
     CNLLP_COMMUNITY(2, 181, 243, cnllp_community4_gpps),
 };
 
+extern const struct intel_pinctrl_soc_data cnllp_soc_data;
+
+#ifndef VOODOOGPIO_HOST
 class VoodooGPIOCannonLakeLP : public VoodooGPIO {
     OSDeclareDefaultStructors(VoodooGPIOCannonLakeLP);
 
     bool start(IOService *provider) override;
 };
+#endif
 
 #endif /* VoodooGPIOCannonLakeLP_h */
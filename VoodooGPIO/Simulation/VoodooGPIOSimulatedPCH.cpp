@@ -0,0 +1,300 @@
+//
+//  VoodooGPIOSimulatedPCH.cpp
+//  VoodooGPIO
+//
+
+#include <string.h>
+#include "VoodooGPIOSimulatedPCH.hpp"
+#include "../VoodooGPIOCore.hpp"
+
+VoodooGPIOSimulatedPCH::VoodooGPIOSimulatedPCH() :
+    reads(0), writes(0), communities(NULL), ncommunities(0), attached(NULL) {
+}
+
+VoodooGPIOSimulatedPCH::~VoodooGPIOSimulatedPCH() {
+    release();
+}
+
+bool VoodooGPIOSimulatedPCH::init(const struct VoodooGPIOSimCommunity *layouts, unsigned count) {
+    release();
+
+    communities = new struct community[count];
+    if (!communities)
+        return false;
+    memset(communities, 0, count * sizeof(struct community));
+    ncommunities = count;
+
+    for (unsigned i = 0; i < count; i++) {
+        struct community *comm = &communities[i];
+
+        comm->layout = layouts[i];
+        comm->stride = comm->layout.revid >= 0x94 ? 16 : 8;
+        comm->size = comm->layout.padbar + comm->layout.npins * comm->stride;
+        comm->regs = new uint32_t[comm->size / 4];
+        comm->held = new uint32_t[comm->layout.ngpps];
+        if (!comm->regs || !comm->held) {
+            release();
+            return false;
+        }
+        memset(comm->regs, 0, comm->size);
+        memset(comm->held, 0, comm->layout.ngpps * sizeof(uint32_t));
+
+        comm->regs[REVID / 4] = comm->layout.revid << REVID_SHIFT;
+        comm->regs[PADBAR / 4] = comm->layout.padbar;
+
+        /* Out of reset every pad is in GPIO driver mode */
+        if (comm->layout.hostown_offset) {
+            for (unsigned gpp = 0; gpp < comm->layout.ngpps; gpp++)
+                comm->regs[comm->layout.hostown_offset / 4 + gpp] = 0xffffffff;
+        }
+    }
+    return true;
+}
+
+void VoodooGPIOSimulatedPCH::release() {
+    for (unsigned i = 0; i < ncommunities; i++) {
+        delete[] communities[i].regs;
+        delete[] communities[i].held;
+    }
+    delete[] communities;
+    communities = NULL;
+    ncommunities = 0;
+}
+
+/**
+ * Lay out a community for every community of @soc, then probe a copy of
+ * the platform communities into @pctl through the core, as
+ * VoodooGPIO::start() does on the real controller. The platform tables
+ * are left alone.
+ *
+ * @param pctl Controller state to fill in, zeroed apart from @pctl->nub.
+ * @param revid REVID reported by every community.
+ * @return false if the platform cannot be laid out or probed.
+ */
+bool VoodooGPIOSimulatedPCH::attach(struct intel_pinctrl *pctl, const struct intel_pinctrl_soc_data *soc,
+                                    uint32_t revid) {
+    size_t count = soc->ncommunities;
+    struct VoodooGPIOSimCommunity *layouts;
+    bool ok;
+
+    detach(pctl);
+
+    attached = new struct intel_community[count];
+    layouts = new struct VoodooGPIOSimCommunity[count];
+    if (!attached || !layouts) {
+        delete[] layouts;
+        detach(pctl);
+        return false;
+    }
+
+    ok = true;
+    for (size_t i = 0; i < count; i++) {
+        struct intel_community *community = &attached[i];
+        struct VoodooGPIOSimCommunity *layout = &layouts[i];
+        uint32_t ngpps = 0, npadown = 0;
+
+        *community = soc->communities[i];
+        community->features = 0;
+        community->gpps_alloc = false;
+        community->mmap = NULL;
+        community->regs = 0;
+        community->pad_regs = 0;
+        community->gpp_state = NULL;
+        community->active_gpps = 0;
+        community->irqs = NULL;
+
+        if (community->gpps) {
+            for (size_t j = 0; j < community->ngpps; j++) {
+                if (community->gpps[j].reg_num + 1 > ngpps)
+                    ngpps = community->gpps[j].reg_num + 1;
+                if (community->gpp_num_padown_regs)
+                    npadown += community->gpp_num_padown_regs;
+                else
+                    npadown += DIV_ROUND_UP(community->gpps[j].size * 4, 32);
+            }
+        } else if (community->gpp_size) {
+            ngpps = DIV_ROUND_UP(community->npins, community->gpp_size);
+            npadown = ngpps * community->gpp_num_padown_regs;
+        } else {
+            ok = false;
+        }
+
+        layout->npins = (uint32_t)community->npins;
+        layout->ngpps = ngpps;
+        layout->npadown = npadown;
+        layout->padown_offset = community->padown_offset;
+        layout->padcfglock_offset = community->padcfglock_offset;
+        layout->hostown_offset = community->hostown_offset;
+        layout->ie_offset = community->ie_offset;
+        layout->padbar = kSimPadBar;
+        layout->revid = revid;
+    }
+
+    if (ok)
+        ok = init(layouts, (unsigned)count);
+    delete[] layouts;
+
+    pctl->backend = this;
+    pctl->communities = attached;
+    pctl->ncommunities = count;
+
+    for (size_t i = 0; ok && i < count; i++)
+        ok = intel_pinctrl_probe_community(pctl, &attached[i], getBase((unsigned)i));
+
+    if (ok)
+        ok = intel_pinctrl_alloc_state(pctl) && intel_pinctrl_pm_init(pctl);
+    if (!ok)
+        detach(pctl);
+    return ok;
+}
+
+/**
+ * Release what attach() set up in @pctl. The simulated registers stay
+ * until release().
+ */
+void VoodooGPIOSimulatedPCH::detach(struct intel_pinctrl *pctl) {
+    if (attached) {
+        intel_pinctrl_pm_release(pctl);
+        intel_pinctrl_release_state(pctl);
+        delete[] attached;
+        attached = NULL;
+        pctl->communities = NULL;
+        pctl->ncommunities = 0;
+    }
+    if (pctl->backend == this)
+        pctl->backend = NULL;
+}
+
+uintptr_t VoodooGPIOSimulatedPCH::getBase(unsigned community) const {
+    return community < ncommunities ? (uintptr_t)communities[community].regs : 0;
+}
+
+struct VoodooGPIOSimulatedPCH::community *VoodooGPIOSimulatedPCH::lookup(uintptr_t addr, uint32_t *offset) {
+    for (unsigned i = 0; i < ncommunities; i++) {
+        struct community *comm = &communities[i];
+        uintptr_t base = (uintptr_t)comm->regs;
+
+        if (addr >= base && addr < base + comm->size) {
+            *offset = (uint32_t)(addr - base) & ~3U;
+            return comm;
+        }
+    }
+    return NULL;
+}
+
+uint32_t VoodooGPIOSimulatedPCH::read32(uintptr_t addr) {
+    struct community *comm;
+    uint32_t offset;
+
+    reads++;
+    comm = lookup(addr, &offset);
+    return comm ? comm->regs[offset / 4] : 0xffffffff;
+}
+
+void VoodooGPIOSimulatedPCH::write32(uint32_t value, uintptr_t addr) {
+    struct community *comm;
+    const struct VoodooGPIOSimCommunity *layout;
+    uint32_t offset, *reg;
+
+    writes++;
+    comm = lookup(addr, &offset);
+    if (!comm)
+        return;
+
+    layout = &comm->layout;
+    reg = &comm->regs[offset / 4];
+
+    if (offset == REVID || offset == PADBAR)
+        return;
+
+    if (offset >= GPI_IS && offset < GPI_IS + layout->ngpps * 4) {
+        /* Write 1 to clear; asserted level sources latch again at once */
+        *reg = (*reg & ~value) | comm->held[(offset - GPI_IS) / 4];
+        return;
+    }
+
+    if (layout->padown_offset && offset >= layout->padown_offset &&
+        offset < layout->padown_offset + layout->npadown * 4)
+        return;
+
+    if (layout->padcfglock_offset && offset >= layout->padcfglock_offset &&
+        offset < layout->padcfglock_offset + layout->ngpps * 8)
+        return;
+
+    if (offset >= layout->padbar && (offset - layout->padbar) % comm->stride == PADCFG0) {
+        *reg = (value & ~PADCFG0_GPIORXSTATE) | (*reg & PADCFG0_GPIORXSTATE);
+        return;
+    }
+
+    *reg = value;
+}
+
+/**
+ * Latch interrupt status bits, as an edge on those pads would.
+ */
+void VoodooGPIOSimulatedPCH::raise(unsigned community, unsigned gpp, uint32_t bits) {
+    if (community >= ncommunities || gpp >= communities[community].layout.ngpps)
+        return;
+    communities[community].regs[GPI_IS / 4 + gpp] |= bits;
+}
+
+/**
+ * Assert or deassert level sources. Asserted bits stay latched in GPI_IS
+ * until deasserted, whatever the host clears.
+ */
+void VoodooGPIOSimulatedPCH::setLevel(unsigned community, unsigned gpp, uint32_t bits, bool asserted) {
+    if (community >= ncommunities || gpp >= communities[community].layout.ngpps)
+        return;
+
+    struct community *comm = &communities[community];
+    if (asserted) {
+        comm->held[gpp] |= bits;
+        comm->regs[GPI_IS / 4 + gpp] |= bits;
+    } else {
+        comm->held[gpp] &= ~bits;
+    }
+}
+
+void VoodooGPIOSimulatedPCH::setRxState(unsigned community, unsigned padno, bool high) {
+    if (community >= ncommunities || padno >= communities[community].layout.npins)
+        return;
+
+    struct community *comm = &communities[community];
+    uint32_t *reg = &comm->regs[(comm->layout.padbar + padno * comm->stride + PADCFG0) / 4];
+    if (high)
+        *reg |= PADCFG0_GPIORXSTATE;
+    else
+        *reg &= ~PADCFG0_GPIORXSTATE;
+}
+
+/**
+ * Write a register bypassing host semantics, e.g. firmware setting
+ * PAD_OWN or PADCFGLOCK.
+ */
+void VoodooGPIOSimulatedPCH::poke(unsigned community, uint32_t offset, uint32_t value) {
+    if (community >= ncommunities || offset >= communities[community].size)
+        return;
+    communities[community].regs[offset / 4] = value;
+}
+
+uint32_t VoodooGPIOSimulatedPCH::peek(unsigned community, uint32_t offset) const {
+    if (community >= ncommunities || offset >= communities[community].size)
+        return 0xffffffff;
+    return communities[community].regs[offset / 4];
+}
+
+/**
+ * Whether the controller interrupt line would be asserted, i.e. any
+ * status bit is set for an enabled pin.
+ */
+bool VoodooGPIOSimulatedPCH::interruptAsserted() const {
+    for (unsigned i = 0; i < ncommunities; i++) {
+        const struct community *comm = &communities[i];
+
+        for (unsigned gpp = 0; gpp < comm->layout.ngpps; gpp++) {
+            if (comm->regs[GPI_IS / 4 + gpp] & comm->regs[comm->layout.ie_offset / 4 + gpp])
+                return true;
+        }
+    }
+    return false;
+}
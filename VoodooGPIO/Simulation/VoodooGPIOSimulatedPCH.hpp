@@ -0,0 +1,98 @@
+//
+//  VoodooGPIOSimulatedPCH.hpp
+//  VoodooGPIO
+//
+//  In-memory model of the Sunrise Point / Cannon Lake GPIO communities,
+//  usable as a register backend in place of the real MMIO.
+//
+
+#ifndef VoodooGPIOSimulatedPCH_h
+#define VoodooGPIOSimulatedPCH_h
+
+#include <stddef.h>
+#include "../VoodooGPIORegisters.hpp"
+
+struct intel_pinctrl;
+struct intel_pinctrl_soc_data;
+
+/* Offset of PADCFG0 of the first pad in communities laid out by attach() */
+#define kSimPadBar  0x600
+
+/**
+ * struct VoodooGPIOSimCommunity - Register layout of a simulated community
+ * @npins: Number of pads (PADCFG entries)
+ * @ngpps: Number of GPI_IS/GPI_IE/HOSTSW_OWN/PADCFGLOCK registers
+ * @npadown: Number of PAD_OWN registers
+ * @padown_offset: Offset of PAD_OWN, %0 if not implemented
+ * @padcfglock_offset: Offset of PADCFGLOCK, %0 if not implemented
+ * @hostown_offset: Offset of HOSTSW_OWN, %0 if not implemented
+ * @ie_offset: Offset of GPI_IE
+ * @padbar: Value of PADBAR, i.e. offset of the first PADCFG0
+ * @revid: Value of REVID[31:16]. %0x94 and up implies PADCFG2 (debounce).
+ */
+struct VoodooGPIOSimCommunity {
+    uint32_t npins;
+    uint32_t ngpps;
+    uint32_t npadown;
+    uint32_t padown_offset;
+    uint32_t padcfglock_offset;
+    uint32_t hostown_offset;
+    uint32_t ie_offset;
+    uint32_t padbar;
+    uint32_t revid;
+};
+
+/**
+ * Simulated PCH GPIO controller.
+ *
+ * Host-side semantics follow the hardware: REVID, PADBAR, PAD_OWN and
+ * PADCFGLOCK are read-only, GPI_IS is write-1-to-clear, GPIORXSTATE in
+ * PADCFG0 is read-only and everything else is plain storage. The "pin side"
+ * calls latch interrupt status and drive pad levels, and poke() stands in
+ * for firmware writing registers the host cannot.
+ */
+class VoodooGPIOSimulatedPCH : public VoodooGPIORegisterBackend {
+ public:
+    VoodooGPIOSimulatedPCH();
+    ~VoodooGPIOSimulatedPCH() override;
+
+    bool init(const struct VoodooGPIOSimCommunity *layouts, unsigned count);
+    void release();
+
+    bool attach(struct intel_pinctrl *pctl, const struct intel_pinctrl_soc_data *soc, uint32_t revid);
+    void detach(struct intel_pinctrl *pctl);
+
+    uintptr_t getBase(unsigned community) const;
+
+    uint32_t read32(uintptr_t addr) override;
+    void write32(uint32_t value, uintptr_t addr) override;
+
+    void raise(unsigned community, unsigned gpp, uint32_t bits);
+    void setLevel(unsigned community, unsigned gpp, uint32_t bits, bool asserted);
+    void setRxState(unsigned community, unsigned padno, bool high);
+    void poke(unsigned community, uint32_t offset, uint32_t value);
+    uint32_t peek(unsigned community, uint32_t offset) const;
+
+    bool interruptAsserted() const;
+
+    uint64_t reads;
+    uint64_t writes;
+
+ private:
+    struct community {
+        struct VoodooGPIOSimCommunity layout;
+        uint32_t *regs;
+        uint32_t *held;
+        size_t size;
+        uint32_t stride;
+    };
+
+    struct community *communities;
+    unsigned ncommunities;
+
+    struct intel_community *attached;
+
+    struct community *lookup(uintptr_t addr, uint32_t *offset);
+};
+
+#endif /* VoodooGPIOSimulatedPCH_h */
@@ -0,0 +1,299 @@
+//
+//  VoodooGPIOTraceReplay.cpp
+//  VoodooGPIO
+//
+
+#include <string.h>
+#include "VoodooGPIOTraceReplay.hpp"
+#include "../linuxirq.h"
+
+#ifdef VOODOOGPIO_HOST
+#include <time.h>
+#else
+#include <IOKit/IOLib.h>
+#endif
+
+static const struct {
+    const char *name;
+    unsigned op;
+} intel_replay_ops[] = {
+    { "Register", kReplayOpRegister },
+    { "Unregister", kReplayOpUnregister },
+    { "Enable", kReplayOpEnable },
+    { "Disable", kReplayOpDisable },
+    { "Raise", kReplayOpRaise },
+    { "Level", kReplayOpLevel },
+    { "Interrupt", kReplayOpInterrupt },
+    { "Sleep", kReplayOpSleep },
+    { "Wake", kReplayOpWake },
+    { "Read", kReplayOpRead },
+    { "Write", kReplayOpWrite },
+    { "Delay", kReplayOpDelay },
+};
+
+VoodooGPIOTraceReplay::VoodooGPIOTraceReplay() :
+    calls(NULL), ncalls(0), calls_lost(false), slots(NULL), padbar(NULL), calls_size(0), storm_deadline(0),
+    awake(false) {
+    memset(&pctl, 0, sizeof(pctl));
+}
+
+VoodooGPIOTraceReplay::~VoodooGPIOTraceReplay() {
+    stop();
+}
+
+/**
+ * @return kReplayOp* operation named @name, kReplayOpInvalid if unknown.
+ */
+unsigned VoodooGPIOTraceReplay::parseOp(const char *name) {
+    for (size_t i = 0; i < ARRAY_SIZE(intel_replay_ops); i++) {
+        if (!strcmp(name, intel_replay_ops[i].name))
+            return intel_replay_ops[i].op;
+    }
+    return kReplayOpInvalid;
+}
+
+/**
+ * Probe @soc into a fresh simulated PCH reporting @revid. The storm limits
+ * are those of VoodooGPIO::intel_gpio_storm_init(), %0 picks its default.
+ */
+bool VoodooGPIOTraceReplay::start(const struct intel_pinctrl_soc_data *soc, uint32_t revid, uint32_t storm_rate,
+                                  uint32_t counter_rate, uint32_t backoff_ms) {
+    stop();
+
+    if (!pch.attach(&pctl, soc, revid))
+        return false;
+
+    slots = new struct slot[pctl.ngpio_map];
+    padbar = new uint32_t[pctl.ncommunities];
+    if (!slots || !padbar) {
+        stop();
+        return false;
+    }
+
+    for (size_t i = 0; i < pctl.ngpio_map; i++) {
+        slots[i].replay = this;
+        slots[i].pin = (uint32_t)i;
+    }
+
+    /* Until the trace says otherwise, it was recorded on this layout */
+    for (size_t i = 0; i < pctl.ncommunities; i++)
+        padbar[i] = (uint32_t)(pctl.communities[i].pad_regs - pctl.communities[i].regs);
+
+    intel_gpio_storm_setup(&pctl, storm_rate ? storm_rate : kStormDefaultRate,
+                           counter_rate ? counter_rate : kCounterDefaultRate,
+                           backoff_ms ? backoff_ms : kStormDefaultBackoffMS);
+
+    /* Only what the steps do is counted, not bringing up the controller */
+    pch.reads = 0;
+    pch.writes = 0;
+    awake = true;
+    return true;
+}
+
+void VoodooGPIOTraceReplay::stop() {
+    pch.detach(&pctl);
+    pch.release();
+
+    delete[] slots;
+    slots = NULL;
+    delete[] padbar;
+    padbar = NULL;
+    delete[] calls;
+    calls = NULL;
+    ncalls = calls_size = 0;
+    calls_lost = false;
+    storm_deadline = 0;
+    awake = false;
+}
+
+void VoodooGPIOTraceReplay::handler(OSObject *owner, void *refcon, IOService *nub, int source) {
+    struct slot *slot = (struct slot *)refcon;
+
+    slot->replay->record(slot->pin);
+}
+
+void VoodooGPIOTraceReplay::record(uint32_t pin) {
+    if (ncalls == calls_size) {
+        size_t size = calls_size ? calls_size * 2 : 16;
+        uint32_t *grown = new uint32_t[size];
+
+        if (!grown) {
+            calls_lost = true;
+            return;
+        }
+        if (calls)
+            memcpy(grown, calls, ncalls * sizeof(uint32_t));
+        delete[] calls;
+        calls = grown;
+        calls_size = size;
+    }
+    calls[ncalls++] = pin;
+}
+
+/**
+ * Move a recorded PADCFG offset from the PADBAR of the traced controller
+ * to that of the simulated community. Other offsets are the same on both.
+ */
+uint32_t VoodooGPIOTraceReplay::rebase(unsigned community, uint32_t offset) {
+    if (community >= pctl.ncommunities || offset < padbar[community])
+        return offset;
+
+    const struct intel_community *comm = &pctl.communities[community];
+    return offset - padbar[community] + (uint32_t)(comm->pad_regs - comm->regs);
+}
+
+/**
+ * @return true if @offset is one of the GPI_IS registers of @community.
+ */
+bool VoodooGPIOTraceReplay::isStatus(unsigned community, uint32_t offset) {
+    const struct intel_community *comm = &pctl.communities[community];
+
+    if (offset < GPI_IS || offset >= padbar[community])
+        return false;
+
+    for (size_t gpp = 0; gpp < comm->ngpps; gpp++) {
+        if (offset == GPI_IS + comm->gpps[gpp].reg_num * 4)
+            return true;
+    }
+    return false;
+}
+
+/**
+ * What stormTimerFired() does, if a throttled pin is waiting for it. Pins
+ * whose backoff has not passed yet stay throttled.
+ */
+void VoodooGPIOTraceReplay::stormTimer() {
+    if (storm_deadline)
+        storm_deadline = intel_gpio_storm_rearm(&pctl);
+}
+
+/**
+ * The controller interrupt: the filter, then the work loop handler if the
+ * filter defers to it.
+ */
+void VoodooGPIOTraceReplay::interrupt() {
+    stormTimer();
+
+    if (intel_gpio_irq_filter(&pctl)) {
+        uint64_t next = intel_gpio_irq_handler(&pctl);
+        if (next)
+            storm_deadline = next;
+    }
+}
+
+/**
+ * @return Value of a register after the steps, at its recorded offset.
+ */
+uint32_t VoodooGPIOTraceReplay::readRegister(unsigned community, uint32_t offset) {
+    return pch.peek(community, rebase(community, offset));
+}
+
+/**
+ * Run one step through the core, as the matching VoodooGPIO method does.
+ * Pin operations the driver would refuse are ignored, like the driver's
+ * return value is by its clients.
+ *
+ * @return false if the step is malformed.
+ */
+bool VoodooGPIOTraceReplay::runStep(const struct intel_replay_step *step) {
+    const struct intel_community *community = NULL;
+    int32_t hw_pin = -1;
+
+    if (step->op == kReplayOpRegister || step->op == kReplayOpUnregister || step->op == kReplayOpEnable ||
+        step->op == kReplayOpDisable) {
+        if (step->pin >= pctl.ngpio_map)
+            return false;
+        hw_pin = intel_gpio_to_pin(&pctl, step->pin, &community, NULL);
+        if (hw_pin < 0)
+            return true;
+    }
+
+    if ((step->op == kReplayOpRead || step->op == kReplayOpWrite) &&
+        (step->community >= pctl.ncommunities || (step->offset & 3)))
+        return false;
+
+    switch (step->op) {
+        case kReplayOpRegister: {
+            struct intel_pin_irq desc;
+
+            memset(&desc, 0, sizeof(desc));
+            desc.mode = INTEL_PIN_IRQ_HANDLER;
+            desc.handler = handler;
+            desc.refcon = &slots[step->pin];
+
+            if (!intel_gpio_claim_irq(&pctl, hw_pin, reinterpret_cast<OSObject *>(this), &desc, step->flag))
+                break;
+            if (step->has_type) {
+                intel_gpio_rearm_pin(&pctl, hw_pin);
+                intel_gpio_store_irq_type(&pctl, hw_pin, step->type);
+            }
+            break;
+        }
+        case kReplayOpUnregister:
+            /* Replayed pins never capture, there is no ring to free */
+            intel_gpio_release_irq(&pctl, hw_pin);
+            break;
+        case kReplayOpEnable: {
+            const struct intel_pin_irq *irq = &community->irqs[hw_pin - community->pin_base];
+
+            intel_gpio_rearm_pin(&pctl, hw_pin);
+            if (irq->owner) {
+                intel_gpio_irq_set_type(&pctl, hw_pin, irq->type);
+                intel_gpio_irq_enable(&pctl, hw_pin);
+            }
+            break;
+        }
+        case kReplayOpDisable:
+            intel_gpio_rearm_pin(&pctl, hw_pin, false);
+            intel_gpio_irq_mask_unmask(&pctl, hw_pin, true);
+            break;
+        case kReplayOpRaise:
+            pch.raise(step->community, step->reg, step->value);
+            break;
+        case kReplayOpLevel:
+            pch.setLevel(step->community, step->reg, step->value, step->flag);
+            break;
+        case kReplayOpInterrupt:
+            interrupt();
+            break;
+        case kReplayOpSleep:
+            awake = false;
+            intel_pinctrl_suspend(&pctl);
+            break;
+        case kReplayOpWake:
+            if (!awake) {
+                awake = true;
+                intel_pinctrl_resume(&pctl, false);
+            }
+            break;
+        case kReplayOpRead:
+            if (step->offset == PADBAR) {
+                padbar[step->community] = step->value;
+            } else if (isStatus(step->community, step->offset)) {
+                /* The pads latched these; the line goes up if any is unmasked */
+                pch.raise(step->community, (step->offset - GPI_IS) / 4, step->value);
+                if (pch.interruptAsserted())
+                    interrupt();
+            } else {
+                pch.poke(step->community, rebase(step->community, step->offset), step->value);
+            }
+            break;
+        case kReplayOpWrite:
+            pch.write32(step->value, pch.getBase(step->community) + rebase(step->community, step->offset));
+            break;
+        case kReplayOpDelay:
+#ifdef VOODOOGPIO_HOST
+            {
+                struct timespec ts = { (time_t)(step->value / 1000), (long)(step->value % 1000) * 1000000 };
+                nanosleep(&ts, NULL);
+            }
+#else
+            IOSleep(step->value);
+#endif
+            stormTimer();
+            break;
+        default:
+            return false;
+    }
+    return !calls_lost;
+}
@@ -0,0 +1,120 @@
+//
+//  VoodooGPIOTraceReplay.hpp
+//  VoodooGPIO
+//
+//  Replays a register trace against the core on a simulated PCH. Shared by
+//  the ReplayTrace hook of debug builds and the host replay test, which
+//  each turn their own trace representation into steps.
+//
+
+#ifndef VoodooGPIOTraceReplay_h
+#define VoodooGPIOTraceReplay_h
+
+#include "VoodooGPIOSimulatedPCH.hpp"
+#include "../VoodooGPIOCore.hpp"
+
+enum {
+    kReplayOpInvalid,
+    kReplayOpRegister,
+    kReplayOpUnregister,
+    kReplayOpEnable,
+    kReplayOpDisable,
+    kReplayOpRaise,
+    kReplayOpLevel,
+    kReplayOpInterrupt,
+    kReplayOpSleep,
+    kReplayOpWake,
+    kReplayOpRead,
+    kReplayOpWrite,
+    kReplayOpDelay,
+};
+
+/**
+ * struct intel_replay_step - One step of a trace
+ * @op: kReplayOp* operation
+ * @pin: GPIO pin of Register, Unregister, Enable and Disable
+ * @type: IRQ_TYPE_* trigger type of Register, if @has_type
+ * @community: Community of Raise, Level, Read and Write
+ * @reg: GPI_IS register number of Raise and Level
+ * @offset: Register offset of Read and Write from the community registers,
+ *          as recorded
+ * @value: Bits of Raise and Level, register value of Read and Write,
+ *         milliseconds of Delay
+ * @has_type: Whether Register sets @type
+ * @flag: Register: filter pin. Level: asserted.
+ */
+struct intel_replay_step {
+    unsigned op;
+    uint32_t pin;
+    uint32_t type;
+    uint32_t community;
+    uint32_t reg;
+    uint32_t offset;
+    uint32_t value;
+    bool has_type;
+    bool flag;
+};
+
+/**
+ * Trace replay on a controller probed into a simulated PCH.
+ *
+ * Steps go through the same core calls as the matching VoodooGPIO methods.
+ * A Read of GPI_IS latches the bits it returned and, if any of them is
+ * unmasked, raises the controller interrupt, so a trace dumped from the
+ * MMIOTrace property drives the dispatcher the way the hardware did. A
+ * Read of PADBAR records where the traced controller had its pads, and
+ * the PADCFG offsets of later steps and of readRegister() are moved to
+ * where the simulated community has them. Other Reads set the simulated
+ * register to the value the host observed.
+ *
+ * Storm throttling runs with the limits given to start(). Pins throttled
+ * during the trace are unmasked again once their backoff has passed, when
+ * the next Interrupt or Delay step runs, as the storm timer would.
+ */
+class VoodooGPIOTraceReplay {
+ public:
+    VoodooGPIOTraceReplay();
+    ~VoodooGPIOTraceReplay();
+
+    static unsigned parseOp(const char *name);
+
+    bool start(const struct intel_pinctrl_soc_data *soc, uint32_t revid, uint32_t storm_rate,
+               uint32_t counter_rate, uint32_t backoff_ms);
+    void stop();
+
+    bool runStep(const struct intel_replay_step *step);
+    uint32_t readRegister(unsigned community, uint32_t offset);
+
+    VoodooGPIOSimulatedPCH pch;
+    struct intel_pinctrl pctl;
+
+    uint32_t *calls;
+    size_t ncalls;
+    bool calls_lost;
+
+ private:
+    /**
+     * struct slot - Client of a replayed GPIO pin
+     * @replay: Replay the handler records into
+     * @pin: GPIO pin recorded on every call
+     */
+    struct slot {
+        VoodooGPIOTraceReplay *replay;
+        uint32_t pin;
+    };
+
+    struct slot *slots;
+    uint32_t *padbar;
+    size_t calls_size;
+    uint64_t storm_deadline;
+    bool awake;
+
+    static void handler(OSObject *owner, void *refcon, IOService *nub, int source);
+    void record(uint32_t pin);
+    uint32_t rebase(unsigned community, uint32_t offset);
+    bool isStatus(unsigned community, uint32_t offset);
+    void stormTimer();
+    void interrupt();
+};
+
+#endif /* VoodooGPIOTraceReplay_h */
@@ -7,82 +7,175 @@
 //
 
 #include "VoodooGPIO.hpp"
+#include "VoodooGPIORegisters.hpp"
+#include "VoodooGPIOBenchmark.hpp"
+#include "VoodooGPIOReplay.hpp"
+
+#ifdef VOODOOGPIO_DEBUG_PROPERTIES
+#include <IOKit/IOUserClient.h>
+#endif
 
 OSDefineMetaClassAndStructors(VoodooGPIO, IOService);
 
 #define kIOPMPowerOff 0
 
-#if defined(__LP64__) && __LP64__
-#define BITS_PER_LONG 64
-#else
-#define BITS_PER_LONG 32
+/* Every register access is accounted to the calling function */
+#define readl(addr)         intel_readl(&pctl, addr, __func__)
+#define writel(b, addr)     intel_writel(&pctl, b, addr, __func__)
+
+#ifdef VOODOOGPIO_MMIO_TRACE
+static const char *intel_mmio_reg_names[] = {
+    "REVID",
+    "PADBAR",
+    "PAD_OWN",
+    "PADCFGLOCK",
+    "HOSTSW_OWN",
+    "GPI_IS",
+    "GPI_IE",
+    "PADCFG0",
+    "PADCFG1",
+    "PADCFG2",
+    "Other",
+};
+
+/**
+ * Find the community @addr belongs to and the kMMIOReg* class of the
+ * register it addresses.
+ *
+ * @param idx Set to the community index, %INTEL_PIN_MAP_NONE if unknown.
+ * @param offset Set to the offset of @addr from the community regs.
+ */
+static unsigned intel_mmio_classify(const struct intel_community *communities, size_t ncommunities,
+                                    IOVirtualAddress addr, UInt8 *idx, UInt32 *offset) {
+    const struct intel_community *community = NULL;
+
+    *idx = INTEL_PIN_MAP_NONE;
+    *offset = 0;
+
+    for (int i = 0; i < ncommunities; i++) {
+        IOVirtualAddress regs = communities[i].regs;
+        if (regs && regs <= addr && (!community || regs > community->regs)) {
+            community = &communities[i];
+            *idx = i;
+        }
+    }
+    if (!community)
+        return kMMIORegOther;
+
+    UInt32 off = (UInt32)(addr - community->regs);
+    UInt32 ngpps = (UInt32)community->ngpps;
+    *offset = off;
+
+    if (community->pad_regs && addr >= community->pad_regs) {
+        unsigned nregs = community->features & PINCTRL_FEATURE_DEBOUNCE ? 4 : 2;
+        switch (((addr - community->pad_regs) / 4) % nregs) {
+            case 0:
+                return kMMIORegPADCFG0;
+            case 1:
+                return kMMIORegPADCFG1;
+            case 2:
+                return kMMIORegPADCFG2;
+            default:
+                return kMMIORegOther;
+        }
+    }
+
+    if (off == REVID)
+        return kMMIORegREVID;
+    if (off == PADBAR)
+        return kMMIORegPADBAR;
+    if (off >= GPI_IS && off < GPI_IS + ngpps * 4)
+        return kMMIORegGPI_IS;
+    if (off >= community->ie_offset && off < community->ie_offset + ngpps * 4)
+        return kMMIORegGPI_IE;
+    if (community->hostown_offset && off >= community->hostown_offset &&
+        off < community->hostown_offset + ngpps * 4)
+        return kMMIORegHOSTSW_OWN;
+    if (community->padcfglock_offset && off >= community->padcfglock_offset &&
+        off < community->padcfglock_offset + ngpps * 8)
+        return kMMIORegPADCFGLOCK;
+    if (community->padown_offset && off >= community->padown_offset)
+        return kMMIORegPAD_OWN;
+    return kMMIORegOther;
+}
+
+/**
+ * Count an MMIO access against its call site and append it to the trace
+ * ring if tracing is on. Safe from primary interrupt context.
+ */
+void VoodooGPIO::intel_mmio_account(IOVirtualAddress addr, UInt32 value, bool write, const char *func) {
+    IOInterruptState is;
+    unsigned reg, hash;
+    UInt32 offset;
+    UInt8 idx;
+
+    if (!mmio_lock)
+        return;
+
+    reg = intel_mmio_classify(pctl.communities, pctl.ncommunities, addr, &idx, &offset);
+    hash = (unsigned)(((uintptr_t)func >> 4) ^ (reg << 1) ^ write);
+
+    is = IOSimpleLockLockDisableInterrupt(mmio_lock);
+
+    mmio_accesses++;
+
+    for (unsigned i = 0; i < kMMIOSites; i++) {
+        struct intel_mmio_site *site = &mmio_sites[(hash + i) % kMMIOSites];
+
+        if (!site->func) {
+            site->reg = reg;
+            site->write = write;
+            site->func = func;
+        }
+        if (site->func == func && site->reg == reg && site->write == write) {
+            site->count++;
+            break;
+        }
+    }
+
+    if (mmio_trace_enabled && mmio_trace) {
+        struct intel_mmio_trace *entry = &mmio_trace[mmio_trace_next];
+
+        entry->time = mach_absolute_time();
+        entry->offset = offset;
+        entry->value = value;
+        entry->community = idx;
+        entry->write = write;
+
+        mmio_trace_next = (mmio_trace_next + 1) % kMMIOTraceEntries;
+        if (mmio_trace_count < kMMIOTraceEntries)
+            mmio_trace_count++;
+    }
+
+    IOSimpleLockUnlockEnableInterrupt(mmio_lock, is);
+}
+
+/**
+ * Register access hook of the core, accounts every access.
+ */
+void VoodooGPIO::intel_mmio_trace_hook(void *ctx, uintptr_t addr, uint32_t value, bool write, const char *func) {
+    ((VoodooGPIO *)ctx)->intel_mmio_account(addr, value, write, func);
+}
 #endif
 
-#define BIT(x) 1UL << x
-#define GENMASK(h, l) \
-(((~0UL) << (l)) & (~0UL >> (BITS_PER_LONG - 1 - (h))))
-
-#define DIV_ROUND_UP(n, d) (((n) + (d) - 1) / (d))
-
-/* Offset from regs */
-#define REVID               0x000
-#define REVID_SHIFT         16
-#define REVID_MASK          GENMASK(31, 16)
-
-#define PADBAR              0x00c
-#define GPI_IS              0x100
-
-#define PADOWN_BITS         4
-#define PADOWN_SHIFT(p)     ((p) % 8 * PADOWN_BITS)
-#define PADOWN_MASK(p)      (0xf << PADOWN_SHIFT(p))
-#define PADOWN_GPP(p)       ((p) / 8)
-
-/* Offset from pad_regs */
-#define PADCFG0                     0x000
-#define PADCFG0_RXEVCFG_SHIFT       25
-#define PADCFG0_RXEVCFG_MASK        (3 << PADCFG0_RXEVCFG_SHIFT)
-#define PADCFG0_RXEVCFG_LEVEL       0
-#define PADCFG0_RXEVCFG_EDGE        1
-#define PADCFG0_RXEVCFG_DISABLED    2
-#define PADCFG0_RXEVCFG_EDGE_BOTH   3
-#define PADCFG0_PREGFRXSEL          BIT(24)
-#define PADCFG0_RXINV               BIT(23)
-#define PADCFG0_GPIROUTIOXAPIC      BIT(20)
-#define PADCFG0_GPIROUTSCI          BIT(19)
-#define PADCFG0_GPIROUTSMI          BIT(18)
-#define PADCFG0_GPIROUTNMI          BIT(17)
-#define PADCFG0_PMODE_SHIFT         10
-#define PADCFG0_PMODE_MASK          (0xf << PADCFG0_PMODE_SHIFT)
-#define PADCFG0_GPIORXDIS           BIT(9)
-#define PADCFG0_GPIOTXDIS           BIT(8)
-#define PADCFG0_GPIORXSTATE         BIT(1)
-#define PADCFG0_GPIOTXSTATE         BIT(0)
-
-#define PADCFG1                     0x004
-#define PADCFG1_TERM_UP             BIT(13)
-#define PADCFG1_TERM_SHIFT          10
-#define PADCFG1_TERM_MASK           (7 << PADCFG1_TERM_SHIFT)
-#define PADCFG1_TERM_20K            4
-#define PADCFG1_TERM_2K             3
-#define PADCFG1_TERM_5K             2
-#define PADCFG1_TERM_1K             1
-
-#define PADCFG2                     0x008
-#define PADCFG2_DEBEN               BIT(0)
-#define PADCFG2_DEBOUNCE_SHIFT      1
-#define PADCFG2_DEBOUNCE_MASK       GENMASK(4, 1)
-
-#define DEBOUNCE_PERIOD             31250 /* ns */
-
-#define pin_to_padno(c, p)      ((p) - (c)->pin_base)
-#define padgroup_offset(g, p)   ((p) - (g)->base)
-
-UInt32 VoodooGPIO::readl(IOVirtualAddress addr) {
-    return *(const volatile UInt32 *)addr;
-}
-
-void VoodooGPIO::writel(UInt32 b, IOVirtualAddress addr) {
-    *(volatile UInt32 *)(addr) = b;
+/**
+ * Route all register accesses through @backend instead of plain loads and
+ * stores. Community register bases must point into the backend's address
+ * space while it is installed. Pass %NULL to go back to MMIO.
+ */
+void VoodooGPIO::setRegisterBackend(VoodooGPIORegisterBackend *backend) {
+    pctl.backend = backend;
+}
+
+void VoodooGPIO::intel_pinctrl_set_soc_data(const struct intel_pinctrl_soc_data *soc) {
+    pins = soc->pins;
+    npins = soc->npins;
+    groups = soc->groups;
+    ngroups = soc->ngroups;
+    functions = soc->functions;
+    nfunctions = soc->nfunctions;
+    communities = soc->communities;
+    ncommunities = soc->ncommunities;
 }
 
 IOWorkLoop* VoodooGPIO::getWorkLoop() {
@@ -105,131 +198,16 @@ IOWorkLoop* VoodooGPIO::getWorkLoop() {
     return workLoop;
 }
 
-struct intel_community *VoodooGPIO::intel_get_community(unsigned pin) {
-    struct intel_community *community;
-    for (int i = 0; i < ncommunities; i++) {
-        community = &communities[i];
-        if (pin >= community->pin_base && pin < community->pin_base + community->npins)
-            return community;
-    }
-
-    IOLog("%s::Failed to find community for pin %u", getName(), pin);
-    return NULL;
-}
-
 const struct intel_padgroup *VoodooGPIO::intel_community_get_padgroup(const struct intel_community *community, unsigned pin) {
-    for (int i = 0; i < community->ngpps; i++) {
-        const struct intel_padgroup *padgrp = &community->gpps[i];
-        if (pin >= padgrp->base && pin < padgrp->base + padgrp->size)
-            return padgrp;
-    }
+    const struct intel_padgroup *padgrp = intel_pin_map_padgroup(pctl.communities, pctl.pin_map, pctl.npin_map,
+                                                                 community, pin);
+    if (padgrp)
+        return padgrp;
 
     IOLog("%s::Failed to find padgroup for pin %u", getName(), pin);
     return NULL;
 }
 
-IOVirtualAddress VoodooGPIO::intel_get_padcfg(unsigned pin, unsigned reg) {
-    const struct intel_community *community;
-    unsigned padno;
-    size_t nregs;
-    
-    community = intel_get_community(pin);
-    if (!community)
-        return 0;
-    
-    padno = pin_to_padno(community, pin);
-    nregs = (community->features & PINCTRL_FEATURE_DEBOUNCE) ? 4 : 2;
-    
-    if (reg == PADCFG2 && !(community->features & PINCTRL_FEATURE_DEBOUNCE))
-        return 0;
-    
-    return community->pad_regs + reg + padno * nregs * 4;
-}
-
-bool VoodooGPIO::intel_pad_owned_by_host(unsigned pin) {
-    const struct intel_community *community;
-    const struct intel_padgroup *padgrp;
-    unsigned gpp, offset, gpp_offset;
-    IOVirtualAddress padown;
-    
-    community = intel_get_community(pin);
-    if (!community)
-        return false;
-    if (!community->padown_offset)
-        return true;
-    
-    padgrp = intel_community_get_padgroup(community, pin);
-    if (!padgrp)
-        return false;
-    
-    gpp_offset = padgroup_offset(padgrp, pin);
-    gpp = PADOWN_GPP(gpp_offset);
-    
-    offset = community->padown_offset + padgrp->padown_num * 4 + gpp * 4;
-    padown = community->regs + offset;
-    
-    return !(readl(padown) & PADOWN_MASK(gpp_offset));
-}
-
-bool VoodooGPIO::intel_pad_acpi_mode(unsigned pin) {
-    const struct intel_community *community;
-    const struct intel_padgroup *padgrp;
-    unsigned offset, gpp_offset;
-    IOVirtualAddress hostown;
-    
-    community = intel_get_community(pin);
-    if (!community)
-        return true;
-    if (!community->hostown_offset)
-        return false;
-    
-    padgrp = intel_community_get_padgroup(community, pin);
-    if (!padgrp)
-        return true;
-    
-    gpp_offset = padgroup_offset(padgrp, pin);
-    offset = community->hostown_offset + padgrp->reg_num * 4;
-    hostown = community->regs + offset;
-    
-    return !(readl(hostown) & BIT(gpp_offset));
-}
-
-bool VoodooGPIO::intel_pad_locked(unsigned pin) {
-    const struct intel_community *community;
-    const struct intel_padgroup *padgrp;
-    unsigned offset, gpp_offset;
-    UInt32 value;
-    
-    community = intel_get_community(pin);
-    if (!community)
-        return true;
-    if (!community->padcfglock_offset)
-        return false;
-    
-    padgrp = intel_community_get_padgroup(community, pin);
-    if (!padgrp)
-        return true;
-    
-    gpp_offset = padgroup_offset(padgrp, pin);
-    
-    /*
-     * If PADCFGLOCK and PADCFGLOCKTX bits are both clear for this pad,
-     * the pad is considered unlocked. Any other case means that it is
-     * either fully or partially locked and we don't touch it.
-     */
-    offset = community->padcfglock_offset + padgrp->reg_num * 8;
-    value = readl(community->regs + offset);
-    if (value & BIT(gpp_offset))
-        return true;
-    
-    offset = community->padcfglock_offset + 4 + padgrp->reg_num * 8;
-    value = readl(community->regs + offset);
-    if (value & BIT(gpp_offset))
-        return true;
-    
-    return false;
-}
-
 /**
  * Translate GPIO offset to hardware pin (They are not always the same).
  * Putting appropriate community and padgroup in the variables.
@@ -242,317 +220,19 @@ bool VoodooGPIO::intel_pad_locked(unsigned pin) {
 SInt32 VoodooGPIO::intel_gpio_to_pin(UInt32 offset,
                                   const struct intel_community **community,
                                   const struct intel_padgroup **padgrp) {
-    int i;
-    for (i = 0; i < ncommunities; i++) {
-        const struct intel_community *comm = &communities[i];
-        int j;
-        for (j = 0; j < comm->ngpps; j++) {
-            const struct intel_padgroup *pgrp = &comm->gpps[j];
-            if (pgrp->gpio_base < 0)
-                continue;
-
-            if (offset >= pgrp->gpio_base &&
-                offset < pgrp->gpio_base + pgrp->size) {
-                int pin;
-
-                pin = pgrp->base + offset - pgrp->gpio_base;
-                if (community)
-                    *community = comm;
-                if (padgrp)
-                    *padgrp = pgrp;
-                return pin;
-            }
-        }
-    }
+    SInt32 pin = ::intel_gpio_to_pin(&pctl, offset, community, padgrp);
+    if (pin >= 0)
+        return pin;
 
     IOLog("%s::Failed getting hardware pin for GPIO pin %u", getName(), offset);
     return -1;
 }
 
 /**
- * @param pin Hardware GPIO pin number to enable.
- */
-void VoodooGPIO::intel_gpio_irq_enable(UInt32 pin) {
-    const struct intel_community *community = intel_get_community(pin);
-    if (community) {
-        const struct intel_padgroup *padgrp = intel_community_get_padgroup(community, pin);
-        if (!padgrp)
-            return;
-
-        UInt32 gpp, gpp_offset;
-        UInt32 value;
-
-        gpp = padgrp->reg_num;
-        gpp_offset = padgroup_offset(padgrp, pin);
-        /* Clear interrupt status first to avoid unexpected interrupt */
-        writel(BIT(gpp_offset), community->regs + GPI_IS + gpp * 4);
-
-        value = readl(community->regs + community->ie_offset + gpp * 4);
-        value |= BIT(gpp_offset);
-        writel(value, community->regs + community->ie_offset + gpp * 4);
-    }
-}
-
-/**
- * @param pin Hardware GPIO pin number to mask.
- * @param mask Whether to mask or unmask.
- */
-void VoodooGPIO::intel_gpio_irq_mask_unmask(unsigned pin, bool mask) {
-    const struct intel_community *community = intel_get_community(pin);
-    if (community) {
-        const struct intel_padgroup *padgrp = intel_community_get_padgroup(community, pin);
-        if (!padgrp)
-            return;
-
-        unsigned gpp, gpp_offset;
-        IOVirtualAddress reg;
-        UInt32 value;
-
-        gpp = padgrp->reg_num;
-        gpp_offset = padgroup_offset(padgrp, pin);
-        
-        reg = community->regs + community->ie_offset + gpp * 4;
-        
-        value = readl(reg);
-        if (mask)
-            value &= ~BIT(gpp_offset);
-        else
-            value |= BIT(gpp_offset);
-        writel(value, reg);
-    }
-}
-
-/**
- * @param pin Hardware GPIO pin number to set its type.
- * @param type Type to set.
+ * Work loop context. Re-arms every pin left pending by a deferred wake.
  */
-bool VoodooGPIO::intel_gpio_irq_set_type(unsigned pin, unsigned type) {
-    IOVirtualAddress reg;
-    UInt32 value;
-    
-    reg = intel_get_padcfg(pin, PADCFG0);
-    if (!reg)
-        return false;
-    
-    /*
-     * If the pin is in ACPI mode it is still usable as a GPIO but it
-     * cannot be used as IRQ because GPI_IS status bit will not be
-     * updated by the host controller hardware.
-     */
-    if (intel_pad_acpi_mode(pin)) {
-        IOLog("%s:: pin %u cannot be used as IRQ\n", getName(), pin);
-        return false;
-    }
-    
-    value = readl(reg);
-    
-    value &= ~(PADCFG0_RXEVCFG_MASK | PADCFG0_RXINV);
-    
-    if ((type & IRQ_TYPE_EDGE_BOTH) == IRQ_TYPE_EDGE_BOTH) {
-        value |= PADCFG0_RXEVCFG_EDGE_BOTH << PADCFG0_RXEVCFG_SHIFT;
-    } else if (type & IRQ_TYPE_EDGE_FALLING) {
-        value |= PADCFG0_RXEVCFG_EDGE << PADCFG0_RXEVCFG_SHIFT;
-        value |= PADCFG0_RXINV;
-    } else if (type & IRQ_TYPE_EDGE_RISING) {
-        value |= PADCFG0_RXEVCFG_EDGE << PADCFG0_RXEVCFG_SHIFT;
-    } else if (type & IRQ_TYPE_LEVEL_MASK) {
-        if (type & IRQ_TYPE_LEVEL_LOW)
-            value |= PADCFG0_RXINV;
-    } else {
-        value |= PADCFG0_RXEVCFG_DISABLED << PADCFG0_RXEVCFG_SHIFT;
-    }
-    
-    writel(value, reg);
-    return true;
-}
-
-bool VoodooGPIO::intel_pinctrl_add_padgroups(intel_community *community) {
-    struct intel_padgroup *gpps;
-    unsigned padown_num = 0;
-    size_t ngpps;
-    
-    if (community->gpps)
-        ngpps = community->ngpps;
-    else
-        ngpps = DIV_ROUND_UP(community->npins, community->gpp_size);
-    
-    gpps = (struct intel_padgroup *)IOMalloc(ngpps * sizeof(struct intel_padgroup));
-    
-    for (int i = 0; i < ngpps; i++) {
-        if (community->gpps) {
-            gpps[i] = community->gpps[i];
-        } else {
-            unsigned gpp_size = community->gpp_size;
-            gpps[i].reg_num = i;
-            gpps[i].base = community->pin_base + i * gpp_size;
-            gpps[i].size = min(gpp_size, npins);
-            gpps[i].gpio_base = 0;
-            npins -= gpps[i].size;
-        }
-
-        if (gpps[i].size > 32) {
-            IOLog("%s::Invalid GPP size for pad group %d\n", getName(), i);
-            return false;
-        }
-
-        // Set gpio_base to base if not specified
-        if (!gpps[i].gpio_base)
-            gpps[i].gpio_base = gpps[i].base;
-
-        gpps[i].padown_num = padown_num;
-        
-        /*
-         * In older hardware the number of padown registers per
-         * group is fixed regardless of the group size.
-         */
-        if (community->gpp_num_padown_regs)
-            padown_num += community->gpp_num_padown_regs;
-        else
-            padown_num += DIV_ROUND_UP(gpps[i].size * 4, 32);
-    }
-    community->gpps = gpps;
-    community->ngpps = ngpps;
-    community->gpps_alloc = true;
-    return true;
-}
-
-bool VoodooGPIO::intel_pinctrl_should_save(unsigned pin) {
-    if (!(intel_pad_owned_by_host(pin) && !intel_pad_locked(pin)))
-        return false;
-    
-    struct intel_community *community = intel_get_community(pin);
-    
-    unsigned communityidx = pin - community->pin_base;
-
-    /*
-     * Only restore the pin if it is actually in use by the kernel (or
-     * by userspace). It is possible that some pins are used by the
-     * BIOS during resume and those are not always locked down so leave
-     * them alone.
-     */
-    if (community->pinInterruptActionOwners[communityidx])
-        return true;
-    return false;
-}
-
-void VoodooGPIO::intel_pinctrl_pm_init() {
-    context.pads = (struct intel_pad_context *)IOMalloc(npins * sizeof(struct intel_pad_context));
-    memset(context.pads, 0, npins * sizeof(struct intel_pad_context));
-    
-    context.communities = (struct intel_community_context *)IOMalloc(ncommunities * sizeof(struct intel_community_context));
-    memset(context.communities, 0, ncommunities * sizeof(struct intel_community_context));
-    
-    for (int i = 0; i < ncommunities; i++) {
-        struct intel_community *community = &communities[i];
-        UInt32 *intmask = (UInt32 *)IOMalloc(community->ngpps * sizeof(UInt32));
-        
-        context.communities[i].intmask = intmask;
-    }
-}
-
-void VoodooGPIO::intel_pinctrl_pm_release() {
-    for (int i = 0; i < ncommunities; i++) {
-        struct intel_community *community = &communities[i];
-        IOFree(context.communities[i].intmask, community->ngpps * sizeof(UInt32));
-        
-        context.communities[i].intmask = NULL;
-    }
-    
-    IOFree(context.communities, ncommunities * sizeof(struct intel_community_context));
-    context.communities = NULL;
-    
-    IOFree(context.pads, npins * sizeof(intel_pad_context));
-    context.pads = NULL;
-}
-
-void VoodooGPIO::intel_pinctrl_suspend() {
-    struct intel_pad_context *pads = context.pads;
-    for (int i = 0; i < npins; i++) {
-        const struct pinctrl_pin_desc *desc = &pins[i];
-        IOVirtualAddress padcfg;
-        uint32_t val;
-        
-        if (!intel_pinctrl_should_save(desc->number))
-            continue;
-        
-        val = readl(intel_get_padcfg(desc->number, PADCFG0));
-        pads[i].padcfg0 = val & ~PADCFG0_GPIORXSTATE;
-        val = readl(intel_get_padcfg(desc->number, PADCFG1));
-        pads[i].padcfg1 = val;
-        
-        padcfg = intel_get_padcfg(desc->number, PADCFG2);
-        if (padcfg)
-            pads[i].padcfg2 = readl(padcfg);
-    }
-    
-    struct intel_community_context *communityContexts = context.communities;
-    for (int i = 0; i < ncommunities; i++) {
-        struct intel_community *community = &communities[i];
-        
-        IOVirtualAddress base = community->regs + community->ie_offset;
-        
-        for (unsigned gpp = 0; gpp < community->ngpps; gpp++)
-            communityContexts[i].intmask[gpp] = readl(base + gpp * 4);
-    }
-}
-
-void VoodooGPIO::intel_gpio_irq_init() {
-    for (size_t i = 0; i < ncommunities; i++) {
-        struct intel_community *community = &communities[i];
-        IOVirtualAddress base = community->regs;
-        
-        for (unsigned gpp = 0; gpp < community->ngpps; gpp++) {
-            /* Mask and clear all interrupts */
-            writel(0, base + community->ie_offset + gpp * 4);
-            writel(0xffff, base + GPI_IS + gpp * 4);
-        }
-    }
-}
-
-void VoodooGPIO::intel_pinctrl_resume() {
-    /* Mask all interrupts */
-    intel_gpio_irq_init();
-    
-    struct intel_pad_context *pads = context.pads;
-    for (int i = 0; i < npins; i++) {
-        const struct pinctrl_pin_desc *desc = &pins[i];
-        IOVirtualAddress padcfg;
-        uint32_t val;
-        
-        if (!intel_pinctrl_should_save(desc->number))
-            continue;
-        
-        padcfg = intel_get_padcfg(desc->number, PADCFG0);
-        val = readl(padcfg) & ~PADCFG0_GPIORXSTATE;
-        if (val != pads[i].padcfg0) {
-            writel(pads[i].padcfg0, padcfg);
-        }
-        
-        padcfg = intel_get_padcfg(desc->number, PADCFG1);
-        val = readl(padcfg);
-        if (val != pads[i].padcfg1) {
-            writel(pads[i].padcfg1, padcfg);
-        }
-        
-        padcfg = intel_get_padcfg(desc->number, PADCFG2);
-        if (padcfg) {
-            val = readl(padcfg);
-            if (val != pads[i].padcfg2) {
-                writel(pads[i].padcfg2, padcfg);
-            }
-        }
-    }
-    
-    struct intel_community_context *communityContexts = context.communities;
-    for (int i = 0; i < ncommunities; i++) {
-        struct intel_community *community = &communities[i];
-        
-        IOVirtualAddress base = communities->regs + communities->ie_offset;
-        
-        for (unsigned gpp = 0; gpp < community->ngpps; gpp++) {
-            writel(communityContexts[i].intmask[gpp], base + gpp * 4);
-        }
-    }
+void VoodooGPIO::rearmTimerFired(OSObject *owner, IOTimerEventSource *timer) {
+    intel_pinctrl_rearm_pending(&pctl);
 }
 
 bool VoodooGPIO::start(IOService *provider) {
@@ -574,7 +254,9 @@ bool VoodooGPIO::start(IOService *provider) {
     }
     workLoop->retain();
     
-    interruptSource = IOInterruptEventSource::interruptEventSource(this, OSMemberFunctionCast(IOInterruptEventAction, this, &VoodooGPIO::InterruptOccurred), provider);
+    interruptSource = IOFilterInterruptEventSource::filterInterruptEventSource(this,
+        OSMemberFunctionCast(IOInterruptEventAction, this, &VoodooGPIO::InterruptOccurred),
+        OSMemberFunctionCast(IOFilterInterruptAction, this, &VoodooGPIO::interruptFilter), provider);
     if (!interruptSource) {
         IOLog("%s::Failed to get GPIO Controller interrupt!\n", getName());
         stop(provider);
@@ -591,7 +273,43 @@ bool VoodooGPIO::start(IOService *provider) {
         return false;
     }
 
+    stormTimer = IOTimerEventSource::timerEventSource(this, OSMemberFunctionCast(IOTimerEventSource::Action, this, &VoodooGPIO::stormTimerFired));
+    if (!stormTimer || (workLoop->addEventSource(stormTimer) != kIOReturnSuccess)) {
+        IOLog("%s::Could not create storm timer\n", getName());
+        stop(provider);
+        return false;
+    }
+
+    intel_gpio_storm_init();
+
+    rearmTimer = IOTimerEventSource::timerEventSource(this, OSMemberFunctionCast(IOTimerEventSource::Action, this, &VoodooGPIO::rearmTimerFired));
+    if (!rearmTimer || (workLoop->addEventSource(rearmTimer) != kIOReturnSuccess)) {
+        IOLog("%s::Could not create re-arm timer\n", getName());
+        stop(provider);
+        return false;
+    }
+
+    OSBoolean *lazy = OSDynamicCast(OSBoolean, getProperty(kLazyRearmKey));
+    lazy_rearm = lazy && lazy->isTrue();
+
+#ifdef VOODOOGPIO_MMIO_TRACE
+    mmio_lock = IOSimpleLockAlloc();
+    mmio_trace = (struct intel_mmio_trace *)IOMalloc(kMMIOTraceEntries * sizeof(struct intel_mmio_trace));
+    if (!mmio_lock || !mmio_trace) {
+        IOLog("%s::Could not allocate MMIO trace\n", getName());
+        stop(provider);
+        return false;
+    }
+
+    pctl.trace = intel_mmio_trace_hook;
+    pctl.trace_ctx = this;
+#endif
+
     IOLog("%s::VoodooGPIO Init!\n", getName());
+
+    pctl.nub = this;
+    pctl.communities = communities;
+    pctl.ncommunities = ncommunities;
     
     for (int i = 0; i < ncommunities; i++) {
         IOLog("%s::VoodooGPIO Initializing Community %d\n", getName(), i);
@@ -606,53 +324,30 @@ bool VoodooGPIO::start(IOService *provider) {
             continue;
         }
         
-        IOVirtualAddress regs = community->mmap->getVirtualAddress();
-        community->regs = regs;
-        
-        /*
-         * Determine community features based on the revision if
-         * not specified already.
-         */
-        if (!community->features) {
-            UInt32 rev;
-            rev = (readl(regs + REVID) & REVID_MASK) >> REVID_SHIFT;
-            if (rev >= 0x94) {
-                community->features |= PINCTRL_FEATURE_DEBOUNCE;
-                community->features |= PINCTRL_FEATURE_1K_PD;
-            }
-        }
-        
-        /* Read offset of the pad configuration registers */
-        UInt32 padbar = readl(regs + PADBAR);
-        
-        community->pad_regs = regs + padbar;
-        
-        if (!intel_pinctrl_add_padgroups(community)) {
+        if (!intel_pinctrl_probe_community(&pctl, community, community->mmap->getVirtualAddress())) {
             IOLog("%s::Error adding padgroups to community %d\n", getName(), i);
         }
     }
-    
-    for (int i = 0; i < ncommunities; i++) {
-        size_t sz = sizeof(OSObject *) * communities[i].npins;
-        communities[i].pinInterruptActionOwners = (OSObject **)IOMalloc(sz);
-        memset(communities[i].pinInterruptActionOwners, 0, sz);
-        
-        sz = sizeof(IOInterruptAction) * communities[i].npins;
-        communities[i].pinInterruptAction = (IOInterruptAction *)IOMalloc(sz);
-        memset(communities[i].pinInterruptAction, 0, sz);
-        
-        sz = sizeof(unsigned) * communities[i].npins;
-        communities[i].interruptTypes = (unsigned *)IOMalloc(sz);
-        memset(communities[i].interruptTypes, 0, sz);
-        
-        sz = sizeof(void *) * communities[i].npins;
-        communities[i].pinInterruptRefcons = (void **)IOMalloc(sz);
-        memset(communities[i].pinInterruptRefcons, 0, sz);
+
+    if (!intel_pinctrl_alloc_state(&pctl)) {
+        IOLog("%s::Failed to allocate controller state\n", getName());
+        stop(provider);
+        return false;
     }
+#ifdef VOODOOGPIO_LATENCY_STATS
+    bzero(gate_latency, sizeof(gate_latency));
+#endif
     
-    intel_pinctrl_pm_init();
+    if (!intel_pinctrl_pm_init(&pctl)) {
+        IOLog("%s::Failed to allocate suspend context\n", getName());
+        stop(provider);
+        return false;
+    }
     
     controllerIsAwake = true;
+
+    /* Nothing is registered yet */
+    intel_gpio_update_idle();
     
     registerService();
     
@@ -677,6 +372,10 @@ bool VoodooGPIO::start(IOService *provider) {
     provider->joinPMtree(this);
     
     registerPowerDriver(this, myPowerStates, kMyNumberOfStates);
+
+#ifdef VOODOOGPIO_MMIO_TRACE
+    mmio_start_cost = mmio_accesses;
+#endif
     
     return true;
 }
@@ -684,25 +383,8 @@ bool VoodooGPIO::start(IOService *provider) {
 void VoodooGPIO::stop(IOService *provider) {
     IOLog("%s::VoodooGPIO stop!\n", getName());
 
-    intel_pinctrl_pm_release();
-    
-    for (int i = 0; i < ncommunities; i++) {
-        if (communities[i].gpps_alloc) {
-            IOFree((void *)communities[i].gpps, communities[i].ngpps * sizeof(struct intel_padgroup));
-            communities[i].gpps = NULL;
-        }
-        
-        for (int j = 0; j < communities[i].npins; j++) {
-            communities[i].pinInterruptActionOwners[j] = NULL;
-            communities[i].pinInterruptAction[j] = NULL;
-            communities[i].interruptTypes[j] = 0;
-            communities[i].pinInterruptRefcons[j] = NULL;
-        }
-        IOFree(communities[i].pinInterruptActionOwners, sizeof(OSObject *) * communities[i].npins);
-        IOFree(communities[i].pinInterruptAction, sizeof(IOInterruptAction) * communities[i].npins);
-        IOFree(communities[i].interruptTypes, sizeof(unsigned) * communities[i].npins);
-        IOFree(communities[i].pinInterruptRefcons, sizeof(void *) * communities[i].npins);
-    }
+    intel_pinctrl_pm_release(&pctl);
+    intel_pinctrl_release_state(&pctl);
     
     if (interruptSource) {
         interruptSource->disable();
@@ -714,11 +396,34 @@ void VoodooGPIO::stop(IOService *provider) {
         workLoop->removeEventSource(command_gate);
         OSSafeReleaseNULL(command_gate);
     }
-    
-    if (workLoop) {
+
+    if (stormTimer) {
+        stormTimer->cancelTimeout();
+        workLoop->removeEventSource(stormTimer);
+        OSSafeReleaseNULL(stormTimer);
+    }
+
+    if (rearmTimer) {
+        rearmTimer->cancelTimeout();
+        workLoop->removeEventSource(rearmTimer);
+        OSSafeReleaseNULL(rearmTimer);
+    }
+    
+    if (workLoop) {
         workLoop->release();
         workLoop = NULL;
     }
+
+#ifdef VOODOOGPIO_MMIO_TRACE
+    if (mmio_trace) {
+        IOFree(mmio_trace, kMMIOTraceEntries * sizeof(struct intel_mmio_trace));
+        mmio_trace = NULL;
+    }
+    if (mmio_lock) {
+        IOSimpleLockFree(mmio_lock);
+        mmio_lock = NULL;
+    }
+#endif
     
     PMstop();
     
@@ -726,79 +431,218 @@ void VoodooGPIO::stop(IOService *provider) {
 }
 
 IOReturn VoodooGPIO::setPowerState(unsigned long powerState, IOService *whatDevice) {
-    if (powerState == 0) {
+    return command_gate->runAction(OSMemberFunctionCast(IOCommandGate::Action, this, &VoodooGPIO::setPowerStateGated), &powerState);
+}
+IOReturn VoodooGPIO::setPowerStateGated(unsigned long *powerState) {
+#ifdef VOODOOGPIO_MMIO_TRACE
+    UInt64 mmio_before = mmio_accesses;
+#endif
+
+    if (*powerState == 0) {
         controllerIsAwake = false;
-        
-        for (int i = 0; i < ncommunities; i++) {
-            struct intel_community *community = &communities[i];
-            for (int j = 0; j < community->npins; j++) {
-                OSObject *pinInterruptOwner = community->pinInterruptActionOwners[j];
-                if (pinInterruptOwner) {
-                    int pin = community->pin_base + j;
-                    intel_gpio_irq_mask_unmask(pin, true);
-                }
-            }
-        }
+
+        /* Pins still pending re-arm are saved as they were; see suspend */
+        if (rearmTimer)
+            rearmTimer->cancelTimeout();
+        intel_pinctrl_suspend(&pctl);
         
         IOLog("%s::Going to Sleep!\n", getName());
     } else {
         if (!controllerIsAwake) {
             controllerIsAwake = true;
+
+            /* Without a work loop there is nothing to re-arm the pins later */
+            bool defer = lazy_rearm && rearmTimer;
+            unsigned clobbered = intel_pinctrl_resume(&pctl, defer);
+            if (defer)
+                rearmTimer->setTimeoutMS(kRearmDelayMS);
             
-            for (int i = 0; i < ncommunities; i++) {
-                struct intel_community *community = &communities[i];
-                for (int j = 0; j < community->npins; j++) {
-                    OSObject *pinInterruptOwner = community->pinInterruptActionOwners[j];
-                    if (pinInterruptOwner) {
-                        int pin = community->pin_base + j;
-                        intel_gpio_irq_set_type(pin, community->interruptTypes[j]);
-                        intel_gpio_irq_enable(pin);
-                    }
-                }
-            }
-            
-            IOLog("%s::Woke up from Sleep!\n", getName());
+            IOLog("%s::Woke up from Sleep! Restored %u registers\n", getName(), clobbered);
         } else {
             IOLog("%s::GPIO Controller is already awake! Not reinitializing.\n", getName());
         }
     }
+
+#ifdef VOODOOGPIO_MMIO_TRACE
+    if (*powerState == 0)
+        mmio_sleep_cost = mmio_accesses - mmio_before;
+    else
+        mmio_wake_cost = mmio_accesses - mmio_before;
+#endif
     return kIOPMAckImplied;
 }
 
-void VoodooGPIO::intel_gpio_community_irq_handler(struct intel_community *community) {
-    for (int gpp = 0; gpp < community->ngpps; gpp++) {
-        const struct intel_padgroup *padgrp = &community->gpps[gpp];
-        
-        unsigned long pending, enabled;
-        
-        pending = readl(community->regs + GPI_IS + padgrp->reg_num * 4);
-        enabled = readl(community->regs + community->ie_offset +
-                        padgrp->reg_num * 4);
-        
-        /* Only interrupts that are enabled */
-        pending &= enabled;
-        
-        unsigned padno = padgrp->base - community->pin_base;
-        if (padno >= community->npins)
-            break;
-        
-        for (int i = 0; i < 32; i++) {
-            bool isPin = (pending >> i) & 0x1;
-            if (isPin) {
-                unsigned pin = padno + i;
-                
-                OSObject *owner = community->pinInterruptActionOwners[pin];
-                if (owner) {
-                    IOInterruptAction handler = community->pinInterruptAction[pin];
-                    void *refcon = community->pinInterruptRefcons[pin];
-                    handler(owner, refcon, this, pin);
-                }
-                
-                if (community->interruptTypes[pin] & IRQ_TYPE_LEVEL_MASK)
-                    intel_gpio_irq_enable(community->pin_base + pin); // For Level interrupts, we need to clear the interrupt status or we get too many interrupts
+#ifdef VOODOOGPIO_LATENCY_STATS
+static OSArray *intel_latency_to_array(const UInt32 *histogram) {
+    OSArray *array = OSArray::withCapacity(kLatencyBuckets);
+    if (!array)
+        return NULL;
+
+    for (unsigned i = 0; i < kLatencyBuckets; i++) {
+        OSNumber *num = OSNumber::withNumber(histogram[i], 32);
+        if (num) {
+            array->setObject(num);
+            num->release();
+        }
+    }
+    return array;
+}
+
+void VoodooGPIO::publishLatencyHistograms() {
+    OSDictionary *dict = OSDictionary::withCapacity(1);
+    if (!dict)
+        return;
+
+    OSArray *array = intel_latency_to_array(gate_latency);
+    if (array) {
+        dict->setObject("GateLatency", array);
+        array->release();
+    }
+
+    for (int i = 0; i < pctl.ncommunities; i++) {
+        const struct intel_community *community = &pctl.communities[i];
+
+        for (unsigned j = 0; community->irqs && j < community->npins; j++) {
+            const struct intel_pin_latency *latency = &pctl.pin_latency[&community->irqs[j] - pctl.pin_irqs];
+            if (!community->irqs[j].count)
+                continue;
+
+            OSDictionary *pin = OSDictionary::withCapacity(2);
+            if (!pin)
+                continue;
+
+            if ((array = intel_latency_to_array(latency->dispatch))) {
+                pin->setObject("DispatchLatency", array);
+                array->release();
+            }
+            if ((array = intel_latency_to_array(latency->handler))) {
+                pin->setObject("HandlerTime", array);
+                array->release();
             }
+
+            char key[16];
+            snprintf(key, sizeof(key), "%u", community->pin_base + j);
+            dict->setObject(key, pin);
+            pin->release();
         }
     }
+
+    setProperty("LatencyHistograms", dict);
+    dict->release();
+}
+
+#endif
+
+#ifdef VOODOOGPIO_DEBUG_PROPERTIES
+IOReturn VoodooGPIO::setProperties(OSObject *properties) {
+    OSDictionary *dict = OSDynamicCast(OSDictionary, properties);
+    if (!dict)
+        return IOService::setProperties(properties);
+
+    /* The hooks below reset accounting, trace MMIO and run long benchmarks */
+    if (IOUserClient::clientHasPrivilege(current_task(), kIOClientPrivilegeAdministrator) != kIOReturnSuccess)
+        return kIOReturnNotPrivileged;
+
+#ifdef VOODOOGPIO_LATENCY_STATS
+    if (dict->getObject("ResetLatencyHistograms")) {
+        bzero(gate_latency, sizeof(gate_latency));
+        if (pctl.pin_latency)
+            bzero(pctl.pin_latency, pctl.npin_irqs * sizeof(struct intel_pin_latency));
+        return kIOReturnSuccess;
+    }
+#endif
+
+#ifdef VOODOOGPIO_MMIO_TRACE
+    if (OSBoolean *enable = OSDynamicCast(OSBoolean, dict->getObject("MMIOTrace"))) {
+        IOInterruptState is = IOSimpleLockLockDisableInterrupt(mmio_lock);
+        mmio_trace_next = 0;
+        mmio_trace_count = 0;
+        mmio_trace_enabled = enable->isTrue();
+        IOSimpleLockUnlockEnableInterrupt(mmio_lock, is);
+        return kIOReturnSuccess;
+    }
+    if (dict->getObject("DumpMMIOTrace")) {
+        publishMMIOTrace();
+        return kIOReturnSuccess;
+    }
+    if (dict->getObject("ResetMMIOAccounting")) {
+        IOInterruptState is = IOSimpleLockLockDisableInterrupt(mmio_lock);
+        bzero(mmio_sites, sizeof(mmio_sites));
+        mmio_accesses = 0;
+        mmio_start_cost = 0;
+        mmio_sleep_cost = 0;
+        mmio_wake_cost = 0;
+        IOSimpleLockUnlockEnableInterrupt(mmio_lock, is);
+        return kIOReturnSuccess;
+    }
+#endif
+
+#ifdef VOODOOGPIO_BENCHMARK
+    if (OSObject *request = dict->getObject(kBenchmarkKey)) {
+        /* Runs on scratch controllers; the live one is not involved */
+        OSNumber *iterations = OSDynamicCast(OSNumber, request);
+        OSDictionary *results = VoodooGPIOBenchmark::run(iterations ? iterations->unsigned32BitValue() : 0);
+        if (!results)
+            return kIOReturnNoMemory;
+        setProperty(kBenchmarkResultsKey, results);
+        results->release();
+        return kIOReturnSuccess;
+    }
+    if (OSDictionary *trace = OSDynamicCast(OSDictionary, dict->getObject(kReplayKey))) {
+        OSDictionary *result = VoodooGPIOReplay::run(trace);
+        if (!result)
+            return kIOReturnBadArgument;
+        setProperty(kReplayResultKey, result);
+        result->release();
+        return kIOReturnSuccess;
+    }
+#endif
+
+    return IOService::setProperties(properties);
+}
+#endif
+
+/**
+ * Interrupt storm limits, overridable from the personality.
+ */
+void VoodooGPIO::intel_gpio_storm_init() {
+    UInt32 storm_rate = kStormDefaultRate;
+    OSNumber *num = OSDynamicCast(OSNumber, getProperty(kStormRateKey));
+    if (num && num->unsigned32BitValue())
+        storm_rate = num->unsigned32BitValue();
+
+    UInt32 counter_rate = kCounterDefaultRate;
+    num = OSDynamicCast(OSNumber, getProperty(kCounterStormRateKey));
+    if (num && num->unsigned32BitValue())
+        counter_rate = num->unsigned32BitValue();
+
+    UInt32 backoff_ms = kStormDefaultBackoffMS;
+    num = OSDynamicCast(OSNumber, getProperty(kStormBackoffKey));
+    if (num && num->unsigned32BitValue())
+        backoff_ms = num->unsigned32BitValue();
+
+    intel_gpio_storm_setup(&pctl, storm_rate, counter_rate, backoff_ms);
+}
+
+/**
+ * Schedule the storm timer for the next throttled pin.
+ *
+ * @param deadline What intel_gpio_storm_rearm() returned, %0 for none.
+ */
+void VoodooGPIO::intel_gpio_storm_arm(UInt64 deadline) {
+    /* Scratch controllers of the benchmark and replay have no timer */
+    if (!deadline || !stormTimer)
+        return;
+
+    UInt64 now = mach_absolute_time();
+    UInt64 delay = 0;
+    if (deadline > now)
+        absolutetime_to_nanoseconds(deadline - now, &delay);
+    stormTimer->setTimeoutMS((UInt32)(delay / kMillisecondScale) + 1);
+}
+
+void VoodooGPIO::stormTimerFired(OSObject *owner, IOTimerEventSource *timer) {
+    intel_gpio_storm_arm(intel_gpio_storm_rearm(&pctl));
 }
 
 /**
@@ -815,44 +659,390 @@ IOReturn VoodooGPIO::getInterruptType(int pin, int *interruptType) {
     return kIOReturnSuccess;
 }
 
+/**
+ * Claim a pin for @target. The descriptor is filled in completely before
+ * the pin gets its owner, so the filter never dispatches it half set up.
+ *
+ * @param pin 'Software' pin number (i.e. GpioInt).
+ * @param desc Delivery of the pin: @mode, the matching handler, ring or
+ *             group, @refcon and @group_index. Other fields are ignored.
+ * @param filter Whether the pin may be dispatched from primary interrupt context.
+ */
+IOReturn VoodooGPIO::intel_gpio_register_interrupt(int pin, OSObject *target, const struct intel_pin_irq *desc, bool filter) {
+    SInt32 hw_pin = intel_gpio_to_pin(pin, nullptr, nullptr);
+    if (hw_pin < 0)
+        return kIOReturnNoInterrupt;
+
+    IOLog("%s::Registering hardware pin %d for GPIO IRQ pin %u", getName(), hw_pin, pin);
+
+    if (!intel_gpio_claim_irq(&pctl, hw_pin, target, desc, filter))
+        return kIOReturnNoResources;
+
+    intel_gpio_update_idle();
+    return kIOReturnSuccess;
+}
+
+/**
+ * Disable the controller interrupt while no pin has a client, so that a
+ * spurious interrupt does not walk the communities, and enable it again
+ * on the first registration.
+ */
+void VoodooGPIO::intel_gpio_update_idle() {
+    if (!interruptSource)
+        return;
+
+    bool idle = intel_pinctrl_idle(&pctl);
+    if (idle == controllerIsIdle)
+        return;
+    controllerIsIdle = idle;
+
+    if (idle) {
+        interruptSource->disable();
+        idle_since = mach_absolute_time();
+        pctl.stats.idle_entries++;
+        IOLog("%s::No pins registered, controller interrupt disabled\n", getName());
+    } else {
+        pctl.stats.idle_time += mach_absolute_time() - idle_since;
+        interruptSource->enable();
+        IOLog("%s::Controller interrupt enabled\n", getName());
+    }
+}
+
 /**
  * @param pin 'Software' pin number (i.e. GpioInt).
  */
 IOReturn VoodooGPIO::registerInterrupt(int pin, OSObject *target, IOInterruptAction handler, void *refcon) {
+    return command_gate->runAction(OSMemberFunctionCast(IOCommandGate::Action, this, &VoodooGPIO::registerInterruptGated), &pin, target, (void *)handler, refcon);
+}
+IOReturn VoodooGPIO::registerInterruptGated(int *pin, OSObject *target, IOInterruptAction handler, void *refcon) {
+    struct intel_pin_irq desc;
+
+    bzero(&desc, sizeof(desc));
+    desc.handler = handler;
+    desc.refcon = refcon;
+    return intel_gpio_register_interrupt(*pin, target, &desc, false);
+}
+
+/**
+ * Like registerInterrupt, but @handler is called directly from primary
+ * interrupt context. It must not block, allocate or take the work loop gate.
+ *
+ * @param pin 'Software' pin number (i.e. GpioInt).
+ */
+IOReturn VoodooGPIO::registerFilterInterrupt(int pin, OSObject *target, IOInterruptAction handler, void *refcon) {
+    return command_gate->runAction(OSMemberFunctionCast(IOCommandGate::Action, this, &VoodooGPIO::registerFilterInterruptGated), &pin, target, (void *)handler, refcon);
+}
+IOReturn VoodooGPIO::registerFilterInterruptGated(int *pin, OSObject *target, IOInterruptAction handler, void *refcon) {
+    struct intel_pin_irq desc;
+
+    bzero(&desc, sizeof(desc));
+    desc.handler = handler;
+    desc.refcon = refcon;
+    return intel_gpio_register_interrupt(*pin, target, &desc, true);
+}
+
+/**
+ * Gated registration of the pins that are not plain handler pins, whose
+ * descriptor does not fit in the command gate arguments.
+ */
+IOReturn VoodooGPIO::registerInterruptModeGated(int *pin, OSObject *target, struct intel_pin_irq *desc, bool *filter) {
+    return intel_gpio_register_interrupt(*pin, target, desc, *filter);
+}
+
+/**
+ * Like registerInterrupt, but @handler also gets the RXSTATE of the pin,
+ * read by the dispatcher in the same scan, and the time of the dispatch,
+ * so the client does not have to read the level itself after the edge.
+ *
+ * @param pin 'Software' pin number (i.e. GpioInt).
+ * @param filter Whether @handler may be called from primary interrupt
+ *               context, as with registerFilterInterrupt.
+ */
+IOReturn VoodooGPIO::registerExtendedInterrupt(int pin, OSObject *target, VoodooGPIOExtendedAction handler, void *refcon,
+                                               bool filter) {
+    if (intel_gpio_to_pin(pin, nullptr, nullptr) < 0)
+        return kIOReturnNoInterrupt;
+    if (!handler)
+        return kIOReturnBadArgument;
+
+    struct intel_pin_irq desc;
+
+    bzero(&desc, sizeof(desc));
+    desc.extended = handler;
+    desc.refcon = refcon;
+    desc.mode = INTEL_PIN_IRQ_EXTENDED;
+    return command_gate->runAction(OSMemberFunctionCast(IOCommandGate::Action, this, &VoodooGPIO::registerInterruptModeGated), &pin, target, &desc, &filter);
+}
+
+/**
+ * Register a pin in capture mode: instead of calling a handler, every
+ * edge is recorded with its timestamp and RXSTATE in a ring the client
+ * drains with drainEdgeCapture(). Edges are recorded from primary
+ * interrupt context. The pin still has to be enabled.
+ *
+ * @param pin 'Software' pin number (i.e. GpioInt).
+ * @param entries Ring size, rounded up to a power of two.
+ */
+IOReturn VoodooGPIO::registerEdgeCapture(int pin, OSObject *target, UInt32 entries) {
+    if (intel_gpio_to_pin(pin, nullptr, nullptr) < 0)
+        return kIOReturnNoInterrupt;
+    if (!target || entries > kEdgeCaptureMaxEntries)
+        return kIOReturnBadArgument;
+
+    UInt32 size = kEdgeCaptureMinEntries;
+    while (size < entries)
+        size <<= 1;
+
+    size_t len = sizeof(struct intel_edge_ring) + size * sizeof(struct intel_edge_event);
+    struct intel_edge_ring *ring = (struct intel_edge_ring *)IOMalloc(len);
+    if (!ring)
+        return kIOReturnNoMemory;
+    bzero(ring, len);
+    ring->mask = size - 1;
+
+    struct intel_pin_irq desc;
+    bool filter = true;
+
+    bzero(&desc, sizeof(desc));
+    desc.capture = ring;
+    desc.mode = INTEL_PIN_IRQ_CAPTURE;
+    IOReturn ret = command_gate->runAction(OSMemberFunctionCast(IOCommandGate::Action, this, &VoodooGPIO::registerInterruptModeGated), &pin, target, &desc, &filter);
+    if (ret != kIOReturnSuccess)
+        IOFree(ring, len);
+    return ret;
+}
+
+/**
+ * Copy the oldest captured edges out of the ring of a pin in capture mode.
+ *
+ * @param pin 'Software' pin number (i.e. GpioInt).
+ * @param events Buffer for the edges, oldest first.
+ * @param count Size of @events on entry, number of edges copied on return.
+ * @param overflows If not %NULL, set to the total number of edges dropped
+ *                  because the ring was full.
+ */
+IOReturn VoodooGPIO::drainEdgeCapture(int pin, struct intel_edge_event *events, UInt32 *count, UInt64 *overflows) {
     const struct intel_community *community;
     SInt32 hw_pin = intel_gpio_to_pin(pin, &community, nullptr);
     if (hw_pin < 0)
         return kIOReturnNoInterrupt;
 
-    IOLog("%s::Registering hardware pin %d for GPIO IRQ pin %u", getName(), hw_pin, pin);
+    /*
+     * Announce the drain before looking at the ring: unregisterInterrupt()
+     * clears @capture first and waits for @drainers before freeing it.
+     */
+    struct intel_pin_irq *irq = &community->irqs[hw_pin - community->pin_base];
+    OSIncrementAtomic(&irq->drainers);
+    OSMemoryBarrier();
+
+    struct intel_edge_ring *ring = irq->capture;
+    if (!irq->owner || irq->mode != INTEL_PIN_IRQ_CAPTURE || !ring) {
+        OSDecrementAtomic(&irq->drainers);
+        return kIOReturnNotReady;
+    }
 
-    unsigned communityidx = hw_pin - community->pin_base;
-    
-    if (community->pinInterruptActionOwners[communityidx])
-        return kIOReturnNoResources;
-    
-    community->pinInterruptActionOwners[communityidx] = target;
-    community->pinInterruptAction[communityidx] = handler;
-    community->pinInterruptRefcons[communityidx] = refcon;
+    UInt32 tail = ring->tail;
+    UInt32 head = ring->head;
+
+    /* Read the entries only after seeing the head that published them */
+    OSMemoryBarrier();
+
+    UInt32 n = min(head - tail, *count);
+    for (UInt32 i = 0; i < n; i++)
+        events[i] = ring->events[(tail + i) & ring->mask];
+
+    /* Done with the slots before handing them back to the dispatcher */
+    OSMemoryBarrier();
+    ring->tail = tail + n;
+
+    *count = n;
+    if (overflows)
+        *overflows = ring->overflows;
+
+    OSDecrementAtomic(&irq->drainers);
     return kIOReturnSuccess;
 }
 
 /**
+ * Register a pin in counting mode: every edge only increments the pin's
+ * counter from primary interrupt context, no handler is called and the
+ * work loop is never scheduled for it. Counting pins have their own storm
+ * limit, kCounterDefaultRate edges per second unless overridden with
+ * CounterStormRate; above it the pin is masked for its backoff period like
+ * any other pin, and edges during that period are not counted. The pin
+ * still has to be enabled.
+ *
+ * @param pin 'Software' pin number (i.e. GpioInt).
+ */
+IOReturn VoodooGPIO::registerEdgeCounter(int pin, OSObject *target) {
+    if (intel_gpio_to_pin(pin, nullptr, nullptr) < 0)
+        return kIOReturnNoInterrupt;
+    if (!target)
+        return kIOReturnBadArgument;
+
+    struct intel_pin_irq desc;
+    bool filter = true;
+
+    bzero(&desc, sizeof(desc));
+    desc.mode = INTEL_PIN_IRQ_COUNTING;
+    return command_gate->runAction(OSMemberFunctionCast(IOCommandGate::Action, this, &VoodooGPIO::registerInterruptModeGated), &pin, target, &desc, &filter);
+}
+
+/**
+ * Read the number of edges seen by a pin in counting mode.
+ *
  * @param pin 'Software' pin number (i.e. GpioInt).
+ * @param count Set to the number of edges since registration or the last reset.
+ * @param reset Atomically clear the counter after reading it.
  */
-IOReturn VoodooGPIO::unregisterInterrupt(int pin) {
+IOReturn VoodooGPIO::readEdgeCounter(int pin, UInt64 *count, bool reset) {
     const struct intel_community *community;
     SInt32 hw_pin = intel_gpio_to_pin(pin, &community, nullptr);
     if (hw_pin < 0)
         return kIOReturnNoInterrupt;
 
-    intel_gpio_irq_mask_unmask(hw_pin, true);
+    struct intel_pin_irq *irq = &community->irqs[hw_pin - community->pin_base];
+    if (!irq->owner || irq->mode != INTEL_PIN_IRQ_COUNTING)
+        return kIOReturnNotReady;
 
-    unsigned communityidx = hw_pin - community->pin_base;
-    community->pinInterruptActionOwners[communityidx] = NULL;
-    community->pinInterruptAction[communityidx] = NULL;
-    community->interruptTypes[communityidx] = 0;
-    community->pinInterruptRefcons[communityidx] = NULL;
+    volatile UInt64 *counter = &irq->count;
+    UInt64 value;
+    do {
+        value = *counter;
+    } while (reset && !OSCompareAndSwap64(value, 0, counter));
+
+    *count = value;
+    return kIOReturnSuccess;
+}
+
+static inline size_t intel_pin_group_size(UInt32 npins) {
+    return sizeof(struct intel_pin_group) + npins * sizeof(int) + 2 * DIV_ROUND_UP(npins, 32) * sizeof(UInt32);
+}
+
+/**
+ * Register several pins for a single client. Instead of one call per pin,
+ * @handler is called from the work loop once per controller interrupt with
+ * a bitmap of the pins that fired and their RXSTATE. Level triggered pins
+ * of the group are acknowledged after @handler returns. The pins still
+ * have to be configured and enabled one by one.
+ *
+ * @param pins 'Software' pin numbers (i.e. GpioInt); bit i of the bitmaps
+ *             passed to @handler is @pins[i].
+ * @param group Set to the handle to pass to unregisterInterruptGroup().
+ */
+IOReturn VoodooGPIO::registerInterruptGroup(const int *pins, UInt32 npins, OSObject *target,
+                                            VoodooGPIOGroupAction handler, void *refcon, struct intel_pin_group **group) {
+    struct intel_pin_group_request request = { pins, npins, target, handler, refcon, group };
+
+    return command_gate->runAction(OSMemberFunctionCast(IOCommandGate::Action, this, &VoodooGPIO::registerInterruptGroupGated), &request);
+}
+IOReturn VoodooGPIO::registerInterruptGroupGated(struct intel_pin_group_request *request) {
+    const int *pins = request->pins;
+    UInt32 npins = request->npins;
+    OSObject *target = request->target;
+
+    if (!pins || !npins || npins > kPinGroupMaxPins || !target || !request->handler || !request->group)
+        return kIOReturnBadArgument;
+
+    size_t len = intel_pin_group_size(npins);
+    struct intel_pin_group *grp = (struct intel_pin_group *)IOMalloc(len);
+    if (!grp)
+        return kIOReturnNoMemory;
+    bzero(grp, len);
+    grp->owner = target;
+    grp->handler = request->handler;
+    grp->refcon = request->refcon;
+    grp->npins = npins;
+    grp->fired = (UInt32 *)&grp->pins[npins];
+    grp->rxstate = grp->fired + DIV_ROUND_UP(npins, 32);
+
+    struct intel_pin_irq desc;
+
+    bzero(&desc, sizeof(desc));
+    desc.group = grp;
+    desc.mode = INTEL_PIN_IRQ_GROUP;
+
+    for (UInt32 i = 0; i < npins; i++) {
+        desc.group_index = i;
+
+        IOReturn ret = intel_gpio_register_interrupt(pins[i], target, &desc, false);
+        if (ret != kIOReturnSuccess) {
+            while (i--)
+                unregisterInterruptGated(&grp->pins[i]);
+            IOFree(grp, len);
+            return ret;
+        }
+        grp->pins[i] = pins[i];
+    }
+
+    *request->group = grp;
+    return kIOReturnSuccess;
+}
+
+/**
+ * Unregister the pins of a group that are still part of it and release it.
+ */
+IOReturn VoodooGPIO::unregisterInterruptGroup(struct intel_pin_group *group) {
+    return command_gate->runAction(OSMemberFunctionCast(IOCommandGate::Action, this, &VoodooGPIO::unregisterInterruptGroupGated), group);
+}
+IOReturn VoodooGPIO::unregisterInterruptGroupGated(struct intel_pin_group *group) {
+    if (!group)
+        return kIOReturnBadArgument;
+
+    for (UInt32 i = 0; i < group->npins; i++) {
+        const struct intel_community *community;
+        SInt32 hw_pin = intel_gpio_to_pin(group->pins[i], &community, nullptr);
+        if (hw_pin < 0)
+            continue;
+
+        const struct intel_pin_irq *irq = &community->irqs[hw_pin - community->pin_base];
+        if (irq->mode == INTEL_PIN_IRQ_GROUP && irq->group == group)
+            unregisterInterruptGated(&group->pins[i]);
+    }
+
+    for (struct intel_pin_group **link = &pctl.pending_groups; *link; link = &(*link)->next_pending) {
+        if (*link == group) {
+            *link = group->next_pending;
+            break;
+        }
+    }
+
+    IOFree(group, intel_pin_group_size(group->npins));
+    return kIOReturnSuccess;
+}
+
+/**
+ * @param pin 'Software' pin number (i.e. GpioInt).
+ */
+IOReturn VoodooGPIO::unregisterInterrupt(int pin) {
+    return command_gate->runAction(OSMemberFunctionCast(IOCommandGate::Action, this, &VoodooGPIO::unregisterInterruptGated), &pin);
+}
+IOReturn VoodooGPIO::unregisterInterruptGated(int *pin) {
+    const struct intel_community *community;
+    SInt32 hw_pin = intel_gpio_to_pin(*pin, &community, nullptr);
+    if (hw_pin < 0)
+        return kIOReturnNoInterrupt;
+
+    struct intel_edge_ring *ring = intel_gpio_release_irq(&pctl, hw_pin);
+    if (ring) {
+        /*
+         * The pin is masked and unregistered, but the filter may still be
+         * recording an edge it picked up before. Disabling the interrupt
+         * source waits for a running filter to return.
+         */
+        if (interruptSource && !controllerIsIdle) {
+            interruptSource->disable();
+            interruptSource->enable();
+        }
+
+        /* A drain that saw the ring before it was cleared may still copy from it */
+        struct intel_pin_irq *irq = &community->irqs[hw_pin - community->pin_base];
+        while (irq->drainers)
+            IOSleep(1);
+        IOFree(ring, sizeof(struct intel_edge_ring) + (ring->mask + 1) * sizeof(struct intel_edge_event));
+    }
+
+    intel_gpio_update_idle();
     return kIOReturnSuccess;
 }
 
@@ -860,15 +1050,21 @@ IOReturn VoodooGPIO::unregisterInterrupt(int pin) {
  * @param pin 'Software' pin number (i.e. GpioInt).
  */
 IOReturn VoodooGPIO::enableInterrupt(int pin) {
+    return command_gate->runAction(OSMemberFunctionCast(IOCommandGate::Action, this, &VoodooGPIO::enableInterruptGated), &pin);
+}
+IOReturn VoodooGPIO::enableInterruptGated(int *pin) {
     const struct intel_community *community;
-    SInt32 hw_pin = intel_gpio_to_pin(pin, &community, nullptr);
+    SInt32 hw_pin = intel_gpio_to_pin(*pin, &community, nullptr);
     if (hw_pin < 0)
         return kIOReturnNoInterrupt;
 
+    intel_gpio_rearm_pin(&pctl, hw_pin);
+
     unsigned communityidx = hw_pin - community->pin_base;
-    if (community->pinInterruptActionOwners[communityidx]) {
-        intel_gpio_irq_set_type(hw_pin, community->interruptTypes[communityidx]);
-        intel_gpio_irq_enable(hw_pin);
+    if (community->irqs[communityidx].owner) {
+        if (!intel_gpio_irq_set_type(&pctl, hw_pin, community->irqs[communityidx].type))
+            IOLog("%s:: pin %u cannot be used as IRQ\n", getName(), hw_pin);
+        intel_gpio_irq_enable(&pctl, hw_pin);
         return kIOReturnSuccess;
     }
     return kIOReturnNoInterrupt;
@@ -878,11 +1074,16 @@ IOReturn VoodooGPIO::enableInterrupt(int pin) {
  * @param pin 'Software' pin number (i.e. GpioInt).
  */
 IOReturn VoodooGPIO::disableInterrupt(int pin) {
-    SInt32 hw_pin = intel_gpio_to_pin(pin, nullptr, nullptr);
+    return command_gate->runAction(OSMemberFunctionCast(IOCommandGate::Action, this, &VoodooGPIO::disableInterruptGated), &pin);
+}
+IOReturn VoodooGPIO::disableInterruptGated(int *pin) {
+    SInt32 hw_pin = intel_gpio_to_pin(*pin, nullptr, nullptr);
     if (hw_pin < 0)
         return kIOReturnNoInterrupt;
 
-    intel_gpio_irq_mask_unmask(hw_pin, true);
+    intel_gpio_rearm_pin(&pctl, hw_pin, false);
+
+    intel_gpio_irq_mask_unmask(&pctl, hw_pin, true);
     return kIOReturnSuccess;
 }
 
@@ -891,22 +1092,568 @@ IOReturn VoodooGPIO::disableInterrupt(int pin) {
  * @param type Interrupt type to set for specified pin.
  */
 IOReturn VoodooGPIO::setInterruptTypeForPin(int pin, int type) {
-    const struct intel_community *community;
-    SInt32 hw_pin = intel_gpio_to_pin(pin, &community, nullptr);
+    return command_gate->runAction(OSMemberFunctionCast(IOCommandGate::Action, this, &VoodooGPIO::setInterruptTypeForPinGated), &pin, &type);
+}
+IOReturn VoodooGPIO::setInterruptTypeForPinGated(int *pin, int *type) {
+    SInt32 hw_pin = intel_gpio_to_pin(*pin, nullptr, nullptr);
     if (hw_pin < 0)
         return kIOReturnNoInterrupt;
 
-    unsigned communityidx = hw_pin - community->pin_base;
-    community->interruptTypes[communityidx] = type;
+    intel_gpio_rearm_pin(&pctl, hw_pin);
+
+    intel_gpio_store_irq_type(&pctl, hw_pin, *type);
+    return kIOReturnSuccess;
+}
+
+/**
+ * Program the hardware debouncer of a pin. Debounce and glitch filter
+ * settings are restored after sleep like the rest of the pad.
+ *
+ * @param pin Hardware GPIO pin number.
+ * @param debounce Debounce time in microseconds, %0 to disable.
+ */
+IOReturn VoodooGPIO::intel_config_set_debounce(unsigned pin, UInt32 debounce) {
+    IOVirtualAddress padcfg2;
+    UInt32 value, bits;
+
+    padcfg2 = intel_get_padcfg(&pctl, pin, PADCFG2);
+    if (!padcfg2)
+        return kIOReturnUnsupported;
+    if (!intel_pad_owned_by_host(&pctl, pin) || intel_pad_locked(&pctl, pin))
+        return kIOReturnNotPermitted;
+
+    if (!intel_debounce_encode(debounce, &bits))
+        return kIOReturnBadArgument;
+
+    value = readl(padcfg2);
+    value &= ~(PADCFG2_DEBEN | PADCFG2_DEBOUNCE_MASK);
+    value |= bits;
+
+    writel(value, padcfg2);
+    return kIOReturnSuccess;
+}
+
+/**
+ * @param pin Hardware GPIO pin number.
+ * @param enable Whether RX goes through the glitch filter.
+ */
+IOReturn VoodooGPIO::intel_config_set_glitch_filter(unsigned pin, bool enable) {
+    IOVirtualAddress padcfg0;
+    UInt32 value;
+
+    /* The filter stage comes with the debouncer */
+    if (!intel_get_padcfg(&pctl, pin, PADCFG2))
+        return kIOReturnUnsupported;
+    if (!intel_pad_owned_by_host(&pctl, pin) || intel_pad_locked(&pctl, pin))
+        return kIOReturnNotPermitted;
+
+    padcfg0 = intel_get_padcfg(&pctl, pin, PADCFG0);
+    value = readl(padcfg0);
+    if (enable)
+        value |= PADCFG0_PREGFRXSEL;
+    else
+        value &= ~PADCFG0_PREGFRXSEL;
+    writel(value, padcfg0);
+    intel_gpio_drop_tx_shadow(&pctl, pin);
+    return kIOReturnSuccess;
+}
+
+/**
+ * Keep the pad configuration of a pin across sleep even when it has no
+ * interrupt client.
+ *
+ * @param pin Hardware GPIO pin number.
+ */
+void VoodooGPIO::intel_pinctrl_keep_pad(unsigned pin) {
+    if (pctl.pad_descs[pin].flags & INTEL_PAD_HAS_PADGROUP)
+        pctl.communities[pctl.pin_map[pin].community].gpp_state[pctl.pin_map[pin].padgroup].configured |= pctl.pad_descs[pin].mask;
+}
+
+/**
+ * @param pin 'Software' pin number (i.e. GpioInt).
+ * @param debounce Debounce time in microseconds, rounded to the nearest
+ *                 period the hardware supports (250us to 1.024s). %0
+ *                 disables the debouncer.
+ */
+IOReturn VoodooGPIO::setDebounceForPin(int pin, UInt32 debounce) {
+    return command_gate->runAction(OSMemberFunctionCast(IOCommandGate::Action, this, &VoodooGPIO::setDebounceForPinGated), &pin, &debounce);
+}
+IOReturn VoodooGPIO::setDebounceForPinGated(int *pin, UInt32 *debounce) {
+    SInt32 hw_pin = intel_gpio_to_pin(*pin, nullptr, nullptr);
+    if (hw_pin < 0)
+        return kIOReturnNoInterrupt;
+
+    intel_gpio_rearm_pin(&pctl, hw_pin);
+
+    IOReturn ret = intel_config_set_debounce(hw_pin, *debounce);
+    if (ret == kIOReturnSuccess)
+        intel_pinctrl_keep_pad(hw_pin);
+    return ret;
+}
+
+/**
+ * @param pin 'Software' pin number (i.e. GpioInt).
+ * @param enable Whether to enable the glitch filter.
+ */
+IOReturn VoodooGPIO::setGlitchFilterForPin(int pin, bool enable) {
+    return command_gate->runAction(OSMemberFunctionCast(IOCommandGate::Action, this, &VoodooGPIO::setGlitchFilterForPinGated), &pin, &enable);
+}
+IOReturn VoodooGPIO::setGlitchFilterForPinGated(int *pin, bool *enable) {
+    SInt32 hw_pin = intel_gpio_to_pin(*pin, nullptr, nullptr);
+    if (hw_pin < 0)
+        return kIOReturnNoInterrupt;
+
+    intel_gpio_rearm_pin(&pctl, hw_pin);
+
+    IOReturn ret = intel_config_set_glitch_filter(hw_pin, *enable);
+    if (ret == kIOReturnSuccess)
+        intel_pinctrl_keep_pad(hw_pin);
+    return ret;
+}
+
+/**
+ * Pins of a pad group whose output may be driven: owned by the host,
+ * unlocked and not in ACPI mode. The per pad group counterpart of
+ * intel_pad_owned_by_host(&pctl), intel_pad_locked(&pctl) and intel_pad_acpi_mode(&pctl).
+ */
+UInt32 VoodooGPIO::intel_gpio_writable_padgroup(const struct intel_community *community, unsigned gpp) {
+    UInt32 writable = intel_pinctrl_snapshot_padgroup(&pctl, community, gpp);
+
+    if (writable && community->hostown_offset)
+        writable &= readl(community->regs + community->hostown_offset + community->gpps[gpp].reg_num * 4);
+    return writable;
+}
+
+/**
+ * @param pin Hardware GPIO pin number.
+ * @return TX state if the output buffer is enabled, RX state otherwise.
+ */
+bool VoodooGPIO::intel_gpio_get_value(unsigned pin) {
+    const struct intel_community *community = &pctl.communities[pctl.pin_map[pin].community];
+    const struct intel_padgroup_state *state = &community->gpp_state[pctl.pin_map[pin].padgroup];
+    UInt32 padcfg0;
+
+    /* A driven output reads back what was last written */
+    if ((state->tx_shadowed & pctl.pad_descs[pin].mask) && !(pctl.tx_shadow[pin] & PADCFG0_GPIOTXDIS))
+        return pctl.tx_shadow[pin] & PADCFG0_GPIOTXSTATE;
+
+    padcfg0 = readl(community->regs + pctl.pad_descs[pin].padcfg + PADCFG0);
+    if (!(padcfg0 & PADCFG0_GPIOTXDIS))
+        return padcfg0 & PADCFG0_GPIOTXSTATE;
+    return padcfg0 & PADCFG0_GPIORXSTATE;
+}
+
+/**
+ * Set the TX state of a pin from its PADCFG0 shadow, which is filled with a
+ * single read on first use. Nothing is written if the state does not change.
+ *
+ * @param pin Hardware GPIO pin number.
+ */
+void VoodooGPIO::intel_gpio_set_value(unsigned pin, bool value) {
+    const struct intel_community *community = &pctl.communities[pctl.pin_map[pin].community];
+    struct intel_padgroup_state *state = &community->gpp_state[pctl.pin_map[pin].padgroup];
+    IOVirtualAddress reg = community->regs + pctl.pad_descs[pin].padcfg + PADCFG0;
+    UInt32 padcfg0;
+
+    if (!(state->tx_shadowed & pctl.pad_descs[pin].mask)) {
+        pctl.tx_shadow[pin] = readl(reg) & ~PADCFG0_GPIORXSTATE;
+        state->tx_shadowed |= pctl.pad_descs[pin].mask;
+    }
+
+    padcfg0 = pctl.tx_shadow[pin];
+    if (value)
+        padcfg0 |= PADCFG0_GPIOTXSTATE;
+    else
+        padcfg0 &= ~PADCFG0_GPIOTXSTATE;
+    if (padcfg0 == pctl.tx_shadow[pin])
+        return;
+
+    writel(padcfg0, reg);
+    pctl.tx_shadow[pin] = padcfg0;
+}
+
+/**
+ * Bits [@start, @start + @size) of a bitmap of @nbits bits, @size <= 32.
+ */
+static UInt32 intel_bitmap_slice(const UInt32 *bitmap, UInt32 nbits, unsigned start, unsigned size) {
+    if (start >= nbits)
+        return 0;
+
+    unsigned word = start / 32;
+    UInt64 bits = bitmap[word];
+    if (word + 1 < DIV_ROUND_UP(nbits, 32))
+        bits |= (UInt64)bitmap[word + 1] << 32;
+    bits >>= start % 32;
+
+    size = min(size, nbits - start);
+    return (UInt32)bits & (size < 32 ? (UInt32)BIT(size) - 1 : 0xffffffff);
+}
+
+/**
+ * Check that every pin set in a GPIO bitmap has a pad behind it.
+ */
+static bool intel_bitmap_valid(const struct intel_pin_map *gpio_map, size_t ngpio_map, const UInt32 *bitmap, UInt32 nbits) {
+    if (nbits > ngpio_map)
+        return false;
+
+    for (UInt32 word = 0; word < DIV_ROUND_UP(nbits, 32); word++) {
+        for (UInt32 bits = bitmap[word]; bits; bits &= bits - 1) {
+            UInt32 offset = word * 32 + __builtin_ctz(bits);
+            if (offset >= nbits)
+                break;
+            if (gpio_map[offset].community == INTEL_PIN_MAP_NONE)
+                return false;
+        }
+    }
+    return true;
+}
+
+/**
+ * @param pin 'Software' pin number (i.e. GpioInt).
+ * @param value Set to the TX state if the pin is an output, otherwise to
+ *              the RX state.
+ */
+IOReturn VoodooGPIO::getGPIOValue(int pin, bool *value) {
+    return command_gate->runAction(OSMemberFunctionCast(IOCommandGate::Action, this, &VoodooGPIO::getGPIOValueGated), &pin, value);
+}
+IOReturn VoodooGPIO::getGPIOValueGated(int *pin, bool *value) {
+    SInt32 hw_pin = intel_gpio_to_pin(*pin, nullptr, nullptr);
+    if (hw_pin < 0)
+        return kIOReturnNoInterrupt;
+    if (!intel_pad_owned_by_host(&pctl, hw_pin))
+        return kIOReturnNotPermitted;
+
+    *value = intel_gpio_get_value(hw_pin);
     return kIOReturnSuccess;
 }
 
+/**
+ * Drive the output of a pin. The pad must already be configured as an
+ * output; its direction is left alone. The level is kept across sleep.
+ *
+ * @param pin 'Software' pin number (i.e. GpioInt).
+ */
+IOReturn VoodooGPIO::setGPIOValue(int pin, bool value) {
+    return command_gate->runAction(OSMemberFunctionCast(IOCommandGate::Action, this, &VoodooGPIO::setGPIOValueGated), &pin, &value);
+}
+IOReturn VoodooGPIO::setGPIOValueGated(int *pin, bool *value) {
+    SInt32 hw_pin = intel_gpio_to_pin(*pin, nullptr, nullptr);
+    if (hw_pin < 0)
+        return kIOReturnNoInterrupt;
+    if (!intel_pad_owned_by_host(&pctl, hw_pin) || intel_pad_locked(&pctl, hw_pin) || intel_pad_acpi_mode(&pctl, hw_pin))
+        return kIOReturnNotPermitted;
+
+    intel_gpio_rearm_pin(&pctl, hw_pin);
+
+    intel_gpio_set_value(hw_pin, *value);
+    intel_pinctrl_keep_pad(hw_pin);
+    return kIOReturnSuccess;
+}
+
+/**
+ * Read several pins at once. The pad ownership of each pad group involved
+ * is read once for all of its pins, followed by one PADCFG0 read per pin
+ * that is not a driven output.
+ *
+ * @param pins Bitmap of 'Software' pin numbers (i.e. GpioInt) to read.
+ * @param values Set to the values of the pins in @pins, other bits cleared.
+ * @param npins Number of bits in both bitmaps.
+ * @return kIOReturnNotPermitted if some pins are not owned by the host;
+ *         their bits are left cleared and the other pins are still read.
+ */
+IOReturn VoodooGPIO::getGPIOValues(const UInt32 *pins, UInt32 *values, UInt32 npins) {
+    return command_gate->runAction(OSMemberFunctionCast(IOCommandGate::Action, this, &VoodooGPIO::getGPIOValuesGated), (void *)pins, values, &npins);
+}
+IOReturn VoodooGPIO::getGPIOValuesGated(const UInt32 *pins, UInt32 *values, UInt32 *npins) {
+    IOReturn ret = kIOReturnSuccess;
+
+    if (!intel_bitmap_valid(pctl.gpio_map, pctl.ngpio_map, pins, *npins))
+        return kIOReturnBadArgument;
+
+    bzero(values, DIV_ROUND_UP(*npins, 32) * sizeof(UInt32));
+
+    for (int i = 0; i < pctl.ncommunities; i++) {
+        const struct intel_community *community = &pctl.communities[i];
+
+        for (unsigned gpp = 0; gpp < community->ngpps; gpp++) {
+            const struct intel_padgroup *padgrp = &community->gpps[gpp];
+            if (padgrp->gpio_base < 0)
+                continue;
+
+            UInt32 want = intel_bitmap_slice(pins, *npins, padgrp->gpio_base, padgrp->size);
+            if (!want)
+                continue;
+
+            UInt32 usable = want & intel_pinctrl_owned_padgroup(&pctl, community, gpp);
+            if (usable != want)
+                ret = kIOReturnNotPermitted;
+
+            for (; usable; usable &= usable - 1) {
+                unsigned k = __builtin_ctz(usable);
+                unsigned offset = padgrp->gpio_base + k;
+
+                if (intel_gpio_get_value(padgrp->base + k))
+                    values[offset / 32] |= BIT(offset % 32);
+            }
+        }
+    }
+
+    return ret;
+}
+
+/**
+ * Drive several outputs at once. Ownership, locking and host mode are read
+ * once per pad group involved; each pin then costs at most one PADCFG0
+ * write, and none if its level does not change.
+ *
+ * @param pins Bitmap of 'Software' pin numbers (i.e. GpioInt) to drive.
+ * @param values Levels of the pins in @pins.
+ * @param npins Number of bits in both bitmaps.
+ * @return kIOReturnNotPermitted if some pins are not owned by the host, are
+ *         locked or are in ACPI mode; those are left alone and the other
+ *         pins are still driven.
+ */
+IOReturn VoodooGPIO::setGPIOValues(const UInt32 *pins, const UInt32 *values, UInt32 npins) {
+    return command_gate->runAction(OSMemberFunctionCast(IOCommandGate::Action, this, &VoodooGPIO::setGPIOValuesGated), (void *)pins, (void *)values, &npins);
+}
+IOReturn VoodooGPIO::setGPIOValuesGated(const UInt32 *pins, const UInt32 *values, UInt32 *npins) {
+    IOReturn ret = kIOReturnSuccess;
+
+    if (!intel_bitmap_valid(pctl.gpio_map, pctl.ngpio_map, pins, *npins))
+        return kIOReturnBadArgument;
+
+    for (int i = 0; i < pctl.ncommunities; i++) {
+        struct intel_community *community = &pctl.communities[i];
+
+        for (unsigned gpp = 0; gpp < community->ngpps; gpp++) {
+            const struct intel_padgroup *padgrp = &community->gpps[gpp];
+            if (padgrp->gpio_base < 0)
+                continue;
+
+            UInt32 want = intel_bitmap_slice(pins, *npins, padgrp->gpio_base, padgrp->size);
+            if (!want)
+                continue;
+
+            UInt32 usable = want & intel_gpio_writable_padgroup(community, gpp);
+            UInt32 high = intel_bitmap_slice(values, *npins, padgrp->gpio_base, padgrp->size);
+            if (usable != want)
+                ret = kIOReturnNotPermitted;
+
+            if (community->gpp_state[gpp].rearm & usable) {
+                unsigned clobbered = intel_pinctrl_rearm_padgroup(&pctl, community, gpp, usable);
+                pctl.stats.wake_clobbered += clobbered;
+                pctl.stats.last_wake_clobbered += clobbered;
+            }
+
+            for (UInt32 bits = usable; bits; bits &= bits - 1) {
+                unsigned k = __builtin_ctz(bits);
+                intel_gpio_set_value(padgrp->base + k, high & BIT(k));
+            }
+            community->gpp_state[gpp].configured |= usable;
+        }
+    }
+
+    return ret;
+}
+
+/**
+ * Primary interrupt context. Dispatches pins registered through
+ * registerFilterInterrupt and leaves everything else to the work loop.
+ *
+ * @return true if other pins are pending and InterruptOccurred must run.
+ */
+bool VoodooGPIO::interruptFilter(OSObject *owner, IOFilterInterruptEventSource *src) {
+    return intel_gpio_irq_filter(&pctl);
+}
+
 void VoodooGPIO::InterruptOccurred(OSObject *owner, IOInterruptEventSource *src, int intCount) {
     command_gate->runAction(OSMemberFunctionCast(IOCommandGate::Action, this, &VoodooGPIO::interruptOccurredGated));
 }
 void VoodooGPIO::interruptOccurredGated() {
-    for (int i = 0; i < ncommunities; i++) {
-        struct intel_community *community = &communities[i];
-        intel_gpio_community_irq_handler(community);
+#ifdef VOODOOGPIO_LATENCY_STATS
+    intel_latency_record(gate_latency, pctl.irq_entry_time, mach_absolute_time());
+#endif
+
+    intel_gpio_storm_arm(intel_gpio_irq_handler(&pctl));
+}
+
+/**
+ * Refresh the statistics properties right before the registry is read.
+ */
+bool VoodooGPIO::serializeProperties(OSSerialize *s) const {
+    const_cast<VoodooGPIO *>(this)->publishStatistics();
+#ifdef VOODOOGPIO_LATENCY_STATS
+    const_cast<VoodooGPIO *>(this)->publishLatencyHistograms();
+#endif
+#ifdef VOODOOGPIO_MMIO_TRACE
+    const_cast<VoodooGPIO *>(this)->publishMMIOAccounting();
+#endif
+    return IOService::serializeProperties(s);
+}
+
+static void setStatistic(OSDictionary *dict, const char *key, UInt64 value) {
+    OSNumber *num = OSNumber::withNumber((unsigned long long)value, 64);
+    if (num) {
+        dict->setObject(key, num);
+        num->release();
     }
 }
+
+void VoodooGPIO::publishStatistics() {
+    OSDictionary *dict = OSDictionary::withCapacity(12);
+    if (!dict)
+        return;
+
+    setStatistic(dict, "Interrupts", pctl.stats.interrupts);
+    setStatistic(dict, "MMIOReads", pctl.stats.mmio_reads);
+    setStatistic(dict, "MMIOWrites", pctl.stats.mmio_writes);
+    /* What the full scan, reading GPI_IS and GPI_IE of every pad group on every interrupt, would cost */
+    setStatistic(dict, "FullScanMMIOReads", pctl.stats.interrupts * 2 * pctl.total_gpps);
+    setStatistic(dict, "StormEvents", pctl.stats.storm_events);
+    setStatistic(dict, "Wakes", pctl.stats.wakes);
+    setStatistic(dict, "WakeClobberedRegisters", pctl.stats.wake_clobbered);
+    setStatistic(dict, "LastWakeClobberedRegisters", pctl.stats.last_wake_clobbered);
+
+    UInt64 idle_time = pctl.stats.idle_time, idle_ms;
+    if (controllerIsIdle)
+        idle_time += mach_absolute_time() - idle_since;
+    absolutetime_to_nanoseconds(idle_time, &idle_ms);
+    idle_ms /= kMillisecondScale;
+    setStatistic(dict, "IdleEntries", pctl.stats.idle_entries);
+    setStatistic(dict, "IdleTimeMS", idle_ms);
+    dict->setObject("Idle", controllerIsIdle ? kOSBooleanTrue : kOSBooleanFalse);
+
+    OSArray *throttled = OSArray::withCapacity(1);
+    if (throttled) {
+        for (int i = 0; i < pctl.ncommunities; i++) {
+            const struct intel_community *community = &pctl.communities[i];
+
+            for (unsigned gpp = 0; community->gpp_state && gpp < community->ngpps; gpp++) {
+                for (UInt32 bits = community->gpp_state[gpp].throttled; bits; bits &= bits - 1) {
+                    OSNumber *pin = OSNumber::withNumber(community->gpps[gpp].base + __builtin_ctz(bits), 32);
+                    if (pin) {
+                        throttled->setObject(pin);
+                        pin->release();
+                    }
+                }
+            }
+        }
+        dict->setObject("ThrottledPins", throttled);
+        throttled->release();
+    }
+
+    setProperty("InterruptStatistics", dict);
+    dict->release();
+}
+
+#ifdef VOODOOGPIO_MMIO_TRACE
+void VoodooGPIO::publishMMIOAccounting() {
+    OSDictionary *dict = OSDictionary::withCapacity(5);
+    OSDictionary *sites = OSDictionary::withCapacity(kMMIOSites);
+    if (!dict || !sites) {
+        OSSafeReleaseNULL(dict);
+        OSSafeReleaseNULL(sites);
+        return;
+    }
+
+    for (unsigned i = 0; i < kMMIOSites; i++) {
+        const struct intel_mmio_site *site = &mmio_sites[i];
+        char key[96];
+
+        if (!site->func)
+            continue;
+        snprintf(key, sizeof(key), "%s/%s/%c", site->func, intel_mmio_reg_names[site->reg], site->write ? 'W' : 'R');
+        setStatistic(sites, key, site->count);
+    }
+    dict->setObject("Sites", sites);
+    sites->release();
+
+    setStatistic(dict, "Total", mmio_accesses);
+    setStatistic(dict, "Start", mmio_start_cost);
+    setStatistic(dict, "LastSleep", mmio_sleep_cost);
+    setStatistic(dict, "LastWake", mmio_wake_cost);
+
+    setProperty("MMIOAccounting", dict);
+    dict->release();
+}
+
+/**
+ * Publish the trace ring, oldest access first, as "MMIOTrace". Recording
+ * is paused while the ring is copied out.
+ *
+ * Every access is a Read or Write step in the format VoodooGPIOReplay
+ * takes, so a dumped trace can be replayed as is. The trace starts with
+ * a PADBAR Read of every community, which the replay needs to place the
+ * PADCFG offsets. TimeNS and Register are informational and ignored by
+ * the replay.
+ */
+void VoodooGPIO::publishMMIOTrace() {
+    IOInterruptState is;
+    UInt32 first, count;
+    bool enabled;
+
+    is = IOSimpleLockLockDisableInterrupt(mmio_lock);
+    enabled = mmio_trace_enabled;
+    mmio_trace_enabled = false;
+    count = mmio_trace_count;
+    first = (mmio_trace_next + kMMIOTraceEntries - count) % kMMIOTraceEntries;
+    IOSimpleLockUnlockEnableInterrupt(mmio_lock, is);
+
+    OSArray *trace = OSArray::withCapacity(pctl.ncommunities + count);
+    if (trace) {
+        for (size_t i = 0; i < pctl.ncommunities; i++) {
+            const struct intel_community *community = &pctl.communities[i];
+            OSDictionary *step = OSDictionary::withCapacity(5);
+            OSString *op = OSString::withCString("Read");
+            OSString *name = OSString::withCString(intel_mmio_reg_names[kMMIORegPADBAR]);
+            if (step && op && name) {
+                step->setObject("Op", op);
+                setStatistic(step, "Community", i);
+                setStatistic(step, "Offset", PADBAR);
+                setStatistic(step, "Value", community->pad_regs - community->regs);
+                step->setObject("Register", name);
+                trace->setObject(step);
+            }
+            OSSafeReleaseNULL(name);
+            OSSafeReleaseNULL(op);
+            OSSafeReleaseNULL(step);
+        }
+
+        for (UInt32 i = 0; i < count; i++) {
+            const struct intel_mmio_trace *entry = &mmio_trace[(first + i) % kMMIOTraceEntries];
+            unsigned reg = kMMIORegOther;
+            UInt64 ns;
+
+            if (entry->community < pctl.ncommunities) {
+                UInt8 idx;
+                UInt32 offset;
+                reg = intel_mmio_classify(pctl.communities, pctl.ncommunities,
+                                          pctl.communities[entry->community].regs + entry->offset, &idx, &offset);
+            }
+
+            OSDictionary *step = OSDictionary::withCapacity(6);
+            OSString *op = OSString::withCString(entry->write ? "Write" : "Read");
+            OSString *name = OSString::withCString(intel_mmio_reg_names[reg]);
+            if (step && op && name) {
+                absolutetime_to_nanoseconds(entry->time, &ns);
+                step->setObject("Op", op);
+                setStatistic(step, "Community", entry->community);
+                setStatistic(step, "Offset", entry->offset);
+                setStatistic(step, "Value", entry->value);
+                setStatistic(step, "TimeNS", ns);
+                step->setObject("Register", name);
+                trace->setObject(step);
+            }
+            OSSafeReleaseNULL(name);
+            OSSafeReleaseNULL(op);
+            OSSafeReleaseNULL(step);
+        }
+        setProperty("MMIOTrace", trace);
+        trace->release();
+    }
+
+    is = IOSimpleLockLockDisableInterrupt(mmio_lock);
+    mmio_trace_enabled = enabled;
+    IOSimpleLockUnlockEnableInterrupt(mmio_lock, is);
+}
+#endif
@@ -11,177 +11,103 @@
 #include <IOKit/acpi/IOACPIPlatformDevice.h>
 #include <IOKit/IOWorkLoop.h>
 #include <IOKit/IOInterruptEventSource.h>
+#include <IOKit/IOFilterInterruptEventSource.h>
 #include <IOKit/IOLocks.h>
 #include <IOKit/IOCommandGate.h>
+#include <IOKit/IOTimerEventSource.h>
 #include "linuxirq.h"
+#include "VoodooGPIOCore.hpp"
 
 #ifndef VoodooGPIO_h
 #define VoodooGPIO_h
 
-struct pinctrl_pin_desc {
-    unsigned number;
-    char *name;
-    void *drv_data;
-};
-
-#define PINCTRL_PIN(a, b) {.number = a, .name = b}
-#define PINCTRL_PIN_ANON(a) {.number = a}
-
 /**
- * struct intel_pingroup - Description about group of pins
- * @name: Name of the groups
- * @pins: All pins in this group
- * @npins: Number of pins in this groups
- * @mode: Native mode in which the group is muxed out @pins. Used if @modes
- *        is %NULL.
- * @modes: If not %NULL this will hold mode for each pin in @pins
+ * struct intel_pin_group_request - Arguments of registerInterruptGroup(),
+ * which are too many to pass through the command gate one by one
  */
-struct intel_pingroup {
-    char *name;
-    unsigned *pins;
-    size_t npins;
-    unsigned short mode;
-    unsigned *modes;
+struct intel_pin_group_request {
+    const int *pins;
+    UInt32 npins;
+    OSObject *target;
+    VoodooGPIOGroupAction handler;
+    void *refcon;
+    struct intel_pin_group **group;
 };
 
-/**
- * struct intel_function - Description about a function
- * @name: Name of the function
- * @groups: An array of groups for this function
- * @ngroups: Number of groups in @groups
- */
-struct intel_function {
-    char *name;
-    char * const *groups;
-    size_t ngroups;
+#ifdef VOODOOGPIO_MMIO_TRACE
+#define kMMIOSites          128
+#define kMMIOTraceEntries   4096
+
+/* Register classes that MMIO accesses are accounted under */
+enum {
+    kMMIORegREVID,
+    kMMIORegPADBAR,
+    kMMIORegPAD_OWN,
+    kMMIORegPADCFGLOCK,
+    kMMIORegHOSTSW_OWN,
+    kMMIORegGPI_IS,
+    kMMIORegGPI_IE,
+    kMMIORegPADCFG0,
+    kMMIORegPADCFG1,
+    kMMIORegPADCFG2,
+    kMMIORegOther,
 };
 
 /**
- * struct intel_padgroup - Hardware pad group information
- * @reg_num: GPI_IS register number
- * @base: Starting pin of this group
- * @size: Size of this group (maximum is 32).
- * @gpio_base: Starting GPIO base of this group (%0 if matches with @base,
- *             and %-1 if no GPIO mapping should be created)
- * @padown_num: PAD_OWN register number (assigned by the core driver)
- *
- * If pad groups of a community are not the same size, use this structure
- * to specify them.
+ * struct intel_mmio_site - MMIO accesses of one call site
+ * @func: Function issuing the access, %NULL if the slot is free
+ * @reg: kMMIOReg* class of the register
+ * @write: Whether the accesses are writes
+ * @count: Number of accesses
  */
-struct intel_padgroup {
-    UInt32 reg_num;
-    UInt32 base;
-    UInt32 size;
-    SInt32 gpio_base;
-    UInt32 padown_num;
+struct intel_mmio_site {
+    const char *func;
+    UInt16 reg;
+    UInt16 write;
+    UInt64 count;
 };
 
 /**
- * struct intel_community - Intel pin community description
- * @barno: MMIO BAR number where registers for this community reside
- * @padown_offset: Register offset of PAD_OWN register from @regs. If %0
- *                 then there is no support for owner.
- * @padcfglock_offset: Register offset of PADCFGLOCK from @regs. If %0 then
- *                     locking is not supported.
- * @hostown_offset: Register offset of HOSTSW_OWN from @regs. If %0 then it
- *                  is assumed that the host owns the pin (rather than
- *                  ACPI).
- * @ie_offset: Register offset of GPI_IE from @regs.
- * @pin_base: Starting pin of pins in this community
- * @gpp_size: Maximum number of pads in each group, such as PADCFGLOCK,
- *            HOSTSW_OWN,  GPI_IS, GPI_IE, etc. Used when @gpps is %NULL.
- * @gpp_num_padown_regs: Number of pad registers each pad group consumes at
- *			 minimum. Use %0 if the number of registers can be
- *			 determined by the size of the group.
- * @npins: Number of pins in this community
- * @features: Additional features supported by the hardware
- * @gpps: Pad groups if the controller has variable size pad groups
- * @ngpps: Number of pad groups in this community
- * @regs: Community specific common registers (reserved for core driver)
- * @pad_regs: Community specific pad registers (reserved for core driver)
- *
- * Most Intel GPIO host controllers this driver supports each pad group is
- * of equal size (except the last one). In that case the driver can just
- * fill in @gpp_size field and let the core driver to handle the rest. If
- * the controller has pad groups of variable size the client driver can
- * pass custom @gpps and @ngpps instead.
+ * struct intel_mmio_trace - MMIO trace ring entry
+ * @time: mach_absolute_time() of the access
+ * @offset: Register offset from the community regs
+ * @value: Value read or written
+ * @community: Community index
+ * @write: Whether the access was a write
  */
-struct intel_community {
-    unsigned barno;
-    unsigned padown_offset;
-    unsigned padcfglock_offset;
-    unsigned hostown_offset;
-    unsigned ie_offset;
-    unsigned pin_base;
-    unsigned gpp_size;
-    unsigned gpp_num_padown_regs;
-    size_t npins;
-    unsigned features;
-    const struct intel_padgroup *gpps;
-    size_t ngpps;
-    bool gpps_alloc;
-    /* Reserved for the core driver */
-    IOMemoryMap *mmap;
-    IOVirtualAddress regs;
-    IOVirtualAddress pad_regs;
-
-    unsigned *interruptTypes;
-    OSObject **pinInterruptActionOwners;
-    IOInterruptAction *pinInterruptAction;
-    void **pinInterruptRefcons;
+struct intel_mmio_trace {
+    UInt64 time;
+    UInt32 offset;
+    UInt32 value;
+    UInt8 community;
+    UInt8 write;
 };
+#endif
 
-struct intel_pad_context {
-    uint32_t padcfg0;
-    uint32_t padcfg1;
-    uint32_t padcfg2;
-};
-
-struct intel_community_context {
-    uint32_t *intmask;
-};
-
-struct intel_pinctrl_context {
-    struct intel_pad_context *pads;
-    struct intel_community_context *communities;
-};
-
-/* Additional features supported by the hardware */
-#define PINCTRL_FEATURE_DEBOUNCE    1
-#define PINCTRL_FEATURE_1K_PD       2
+#if defined(VOODOOGPIO_LATENCY_STATS) || defined(VOODOOGPIO_BENCHMARK) || defined(VOODOOGPIO_MMIO_TRACE)
+#define VOODOOGPIO_DEBUG_PROPERTIES 1
+#endif
 
-#define ARRAY_SIZE(x) (sizeof(x) / sizeof((x)[0]))
+/* Interrupt storm detection */
+#define kStormRateKey           "StormRate"
+#define kStormBackoffKey        "StormBackoffMS"
+#define kCounterStormRateKey    "CounterStormRate"
 
-/**
- * PIN_GROUP - Declare a pin group
- * @n: Name of the group
- * @p: An array of pins this group consists
- * @m: Mode which the pins are put when this group is active. Can be either
- *     a single integer or an array of integers in which case mode is per
- *     pin.
- */
-#define PIN_GROUP(n, p, m)                          \
-{                                                   \
-    .name = (n),                                    \
-    .pins = (p),                                    \
-    .npins = ARRAY_SIZE((p)),                       \
-    .mode = __builtin_choose_expr(                  \
-            __builtin_constant_p((m)), (m), 0),     \
-    .modes = __builtin_choose_expr(                 \
-            __builtin_constant_p((m)), NULL, (m)),  \
-}
-
-#define FUNCTION(n, g)          \
-{                               \
-    .name = (n),                \
-    .groups = (g),              \
-    .ngroups = ARRAY_SIZE((g)), \
-}
+/* Deferred re-arm of registered pins after wake */
+#define kLazyRearmKey           "LazyWakeRearm"
+#define kRearmDelayMS           10
 
 class VoodooGPIO : public IOService {
     OSDeclareDefaultStructors(VoodooGPIO);
 
+#ifdef VOODOOGPIO_BENCHMARK
+    friend class VoodooGPIOBenchmark;
+#endif
+
  protected:
+    void setRegisterBackend(VoodooGPIORegisterBackend *backend);
+    void intel_pinctrl_set_soc_data(const struct intel_pinctrl_soc_data *soc);
+
     struct pinctrl_pin_desc *pins;
     size_t npins;
     const struct intel_pingroup *groups;
@@ -192,53 +118,97 @@ class VoodooGPIO : public IOService {
     size_t ncommunities;
 
  private:
-    struct intel_pinctrl_context context;
+    struct intel_pinctrl pctl;
+
+#ifdef VOODOOGPIO_LATENCY_STATS
+    UInt32 gate_latency[kLatencyBuckets];
+
+    void publishLatencyHistograms();
+#endif
 
     bool controllerIsAwake;
+    bool lazy_rearm;
+    bool controllerIsIdle;
+    UInt64 idle_since;
 
     IOWorkLoop *workLoop;
-    IOInterruptEventSource *interruptSource;
+    IOFilterInterruptEventSource *interruptSource;
     IOCommandGate* command_gate;
-
-    UInt32 readl(IOVirtualAddress addr);
-    void writel(UInt32 b, IOVirtualAddress addr);
+    IOTimerEventSource *stormTimer;
+    IOTimerEventSource *rearmTimer;
+
+#ifdef VOODOOGPIO_MMIO_TRACE
+    IOSimpleLock *mmio_lock;
+    struct intel_mmio_site mmio_sites[kMMIOSites];
+    struct intel_mmio_trace *mmio_trace;
+    UInt32 mmio_trace_next;
+    UInt32 mmio_trace_count;
+    bool mmio_trace_enabled;
+    UInt64 mmio_accesses;
+    UInt64 mmio_start_cost;
+    UInt64 mmio_sleep_cost;
+    UInt64 mmio_wake_cost;
+
+    void intel_mmio_account(IOVirtualAddress addr, UInt32 value, bool write, const char *func);
+    static void intel_mmio_trace_hook(void *ctx, uintptr_t addr, uint32_t value, bool write, const char *func);
+    void publishMMIOAccounting();
+    void publishMMIOTrace();
+#endif
 
     IOWorkLoop* getWorkLoop();
 
-    struct intel_community *intel_get_community(unsigned pin);
     const struct intel_padgroup *intel_community_get_padgroup(const struct intel_community *community, unsigned pin);
-    IOVirtualAddress intel_get_padcfg(unsigned pin, unsigned reg);
-
-    bool intel_pad_owned_by_host(unsigned pin);
-    bool intel_pad_acpi_mode(unsigned pin);
-    bool intel_pad_locked(unsigned pin);
-
     SInt32 intel_gpio_to_pin(UInt32 offset,
                           const struct intel_community **community,
                           const struct intel_padgroup **padgrp);
-    void intel_gpio_irq_enable(UInt32 pin);
-    void intel_gpio_irq_mask_unmask(unsigned pin, bool mask);
-    bool intel_gpio_irq_set_type(unsigned pin, unsigned type);
+    void intel_gpio_update_idle();
+
+    IOReturn intel_config_set_debounce(unsigned pin, UInt32 debounce);
+    IOReturn intel_config_set_glitch_filter(unsigned pin, bool enable);
+    void intel_pinctrl_keep_pad(unsigned pin);
 
-    bool intel_pinctrl_add_padgroups(intel_community *community);
+    UInt32 intel_gpio_writable_padgroup(const struct intel_community *community, unsigned gpp);
+    bool intel_gpio_get_value(unsigned pin);
+    void intel_gpio_set_value(unsigned pin, bool value);
 
-    bool intel_pinctrl_should_save(unsigned pin);
-    void intel_pinctrl_pm_init();
-    void intel_pinctrl_pm_release();
-    void intel_pinctrl_suspend();
-    void intel_gpio_irq_init();
-    void intel_pinctrl_resume();
+    void rearmTimerFired(OSObject *owner, IOTimerEventSource *timer);
 
-    void intel_gpio_community_irq_handler(struct intel_community *community);
+    void intel_gpio_storm_init();
+    void intel_gpio_storm_arm(UInt64 deadline);
+    void stormTimerFired(OSObject *owner, IOTimerEventSource *timer);
+    IOReturn intel_gpio_register_interrupt(int pin, OSObject *target, const struct intel_pin_irq *desc, bool filter);
 
+    bool interruptFilter(OSObject *owner, IOFilterInterruptEventSource *src);
     void InterruptOccurred(OSObject *owner, IOInterruptEventSource *src, int intCount);
     void interruptOccurredGated();
 
+    IOReturn registerInterruptGated(int *pin, OSObject *target, IOInterruptAction handler, void *refcon);
+    IOReturn registerFilterInterruptGated(int *pin, OSObject *target, IOInterruptAction handler, void *refcon);
+    IOReturn registerInterruptModeGated(int *pin, OSObject *target, struct intel_pin_irq *desc, bool *filter);
+    IOReturn unregisterInterruptGated(int *pin);
+    IOReturn enableInterruptGated(int *pin);
+    IOReturn disableInterruptGated(int *pin);
+    IOReturn setInterruptTypeForPinGated(int *pin, int *type);
+    IOReturn setDebounceForPinGated(int *pin, UInt32 *debounce);
+    IOReturn setGlitchFilterForPinGated(int *pin, bool *enable);
+    IOReturn getGPIOValueGated(int *pin, bool *value);
+    IOReturn setGPIOValueGated(int *pin, bool *value);
+    IOReturn getGPIOValuesGated(const UInt32 *pins, UInt32 *values, UInt32 *npins);
+    IOReturn setGPIOValuesGated(const UInt32 *pins, const UInt32 *values, UInt32 *npins);
+    IOReturn setPowerStateGated(unsigned long *powerState);
+    IOReturn registerInterruptGroupGated(struct intel_pin_group_request *request);
+    IOReturn unregisterInterruptGroupGated(struct intel_pin_group *group);
+
+    void publishStatistics();
+
     void TouchpadInterruptOccurred(OSObject *owner, IOInterruptEventSource *src, int intCount);
 
  public:
     IOReturn getInterruptType(int pin, int *interruptType) override;
     IOReturn registerInterrupt(int pin, OSObject *target, IOInterruptAction handler, void *refcon) override;
+    IOReturn registerFilterInterrupt(int pin, OSObject *target, IOInterruptAction handler, void *refcon);
+    IOReturn registerExtendedInterrupt(int pin, OSObject *target, VoodooGPIOExtendedAction handler, void *refcon,
+                                       bool filter);
     IOReturn unregisterInterrupt(int pin) override;
 
     IOReturn enableInterrupt(int pin) override;
@@ -246,10 +216,33 @@ class VoodooGPIO : public IOService {
 
     IOReturn setInterruptTypeForPin(int pin, int type);
 
+    IOReturn registerEdgeCapture(int pin, OSObject *target, UInt32 entries);
+    IOReturn drainEdgeCapture(int pin, struct intel_edge_event *events, UInt32 *count, UInt64 *overflows);
+
+    IOReturn registerEdgeCounter(int pin, OSObject *target);
+    IOReturn readEdgeCounter(int pin, UInt64 *count, bool reset);
+
+    IOReturn registerInterruptGroup(const int *pins, UInt32 npins, OSObject *target,
+                                    VoodooGPIOGroupAction handler, void *refcon, struct intel_pin_group **group);
+    IOReturn unregisterInterruptGroup(struct intel_pin_group *group);
+
+    IOReturn setDebounceForPin(int pin, UInt32 debounce);
+    IOReturn setGlitchFilterForPin(int pin, bool enable);
+
+    IOReturn getGPIOValue(int pin, bool *value);
+    IOReturn setGPIOValue(int pin, bool value);
+    IOReturn getGPIOValues(const UInt32 *pins, UInt32 *values, UInt32 npins);
+    IOReturn setGPIOValues(const UInt32 *pins, const UInt32 *values, UInt32 npins);
+
     bool start(IOService *provider) override;
     void stop(IOService *provider) override;
 
     IOReturn setPowerState(unsigned long powerState, IOService *whatDevice) override;
+
+    bool serializeProperties(OSSerialize *s) const override;
+#ifdef VOODOOGPIO_DEBUG_PROPERTIES
+    IOReturn setProperties(OSObject *properties) override;
+#endif
 };
 
 #endif /* VoodooGPIO_h */
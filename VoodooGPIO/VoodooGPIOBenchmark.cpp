@@ -0,0 +1,631 @@
+//
+//  VoodooGPIOBenchmark.cpp
+//  VoodooGPIO
+//
+
+#include "VoodooGPIOBenchmark.hpp"
+
+#ifdef VOODOOGPIO_BENCHMARK
+
+#include "VoodooGPIORegisters.hpp"
+#include "Simulation/VoodooGPIOSimulatedPCH.hpp"
+
+extern const struct intel_pinctrl_soc_data sptlp_soc_data;
+extern const struct intel_pinctrl_soc_data spth_soc_data;
+extern const struct intel_pinctrl_soc_data cnllp_soc_data;
+extern const struct intel_pinctrl_soc_data cnlh_soc_data;
+
+static const struct {
+    const struct intel_pinctrl_soc_data *soc;
+    UInt32 revid;
+} bench_platforms[] = {
+    { &sptlp_soc_data, 0x00 },
+    { &spth_soc_data, 0x00 },
+    { &cnllp_soc_data, 0x94 },
+    { &cnlh_soc_data, 0x94 },
+};
+
+enum {
+    kScenarioSinglePin,     /* One edge pin, every interrupt */
+    kScenarioAllPins,       /* Every mapped pin of every community at once */
+    kScenarioMixed,         /* Every mapped pin, alternating edge and level */
+    kScenarioCounting,      /* One edge pin in counting mode, every interrupt */
+    kScenarioFilterPin,     /* One edge pin dispatched from the filter, every interrupt */
+    kScenarioCount,
+
+    kScenarioPending = kScenarioCount,  /* The first npins edge pins, see runLoopComparison() */
+};
+
+static const char *bench_scenario_names[kScenarioCount] = {
+    "SinglePin",
+    "AllPins",
+    "MixedLevelEdge",
+    "CountingPin",
+    "FilterPin",
+};
+
+/**
+ * struct intel_bench_pin - Client side of a benchmark pin
+ * @pch: Simulated controller
+ * @dispatched: Handler call counter of the scenario
+ * @community: Community index
+ * @reg: GPI_IS register number of the pad group
+ * @mask: Bit of the pin in @reg
+ * @level: Whether the pin is level triggered and must be deasserted
+ * @registered: Whether the pin is registered with the controller
+ * @handled: mach_absolute_time() of the last handler call
+ */
+struct intel_bench_pin {
+    VoodooGPIOSimulatedPCH *pch;
+    UInt64 *dispatched;
+    UInt8 community;
+    UInt8 reg;
+    UInt32 mask;
+    bool level;
+    bool registered;
+    UInt64 handled;
+};
+
+/**
+ * struct intel_bench_gpp - Pins of a pad group raised on every iteration
+ */
+struct intel_bench_gpp {
+    UInt8 community;
+    UInt8 reg;
+    UInt32 edge;
+    UInt32 level;
+};
+
+static void intel_bench_handler(OSObject *owner, void *refcon, IOService *nub, int source) {
+    struct intel_bench_pin *pin = (struct intel_bench_pin *)refcon;
+
+    pin->handled = mach_absolute_time();
+    (*pin->dispatched)++;
+
+    /* Quiesce the source, as a client of a level interrupt would */
+    if (pin->level)
+        pin->pch->setLevel(pin->community, pin->reg, pin->mask, false);
+}
+
+/* Waits for the work loop, see runWakeupLatency() */
+static IOReturn intel_bench_sync(OSObject *owner, void *arg0, void *arg1, void *arg2, void *arg3) {
+    return kIOReturnSuccess;
+}
+
+/* Pending pin counts the current and baseline dispatch loops are compared at */
+static const unsigned bench_loop_pending[] = { 1, 4, 32 };
+
+static void intel_bench_set(OSDictionary *dict, const char *key, UInt64 value) {
+    OSNumber *num = OSNumber::withNumber((unsigned long long)value, 64);
+    if (num) {
+        dict->setObject(key, num);
+        num->release();
+    }
+}
+
+/**
+ * Look up a platform table by its soc name, e.g. "CannonLake-LP".
+ *
+ * @param revid Set to the REVID the platform is simulated with.
+ * @return The platform table, or %NULL if there is none by that name.
+ */
+const struct intel_pinctrl_soc_data *VoodooGPIOBenchmark::findPlatform(const char *name, UInt32 *revid) {
+    for (int i = 0; i < ARRAY_SIZE(bench_platforms); i++) {
+        if (!strcmp(bench_platforms[i].soc->name, name)) {
+            *revid = bench_platforms[i].revid;
+            return bench_platforms[i].soc;
+        }
+    }
+    return NULL;
+}
+
+/**
+ * Load @soc into a new controller instance backed by @pch. The platform
+ * communities are copied, so the live controller's tables are left alone.
+ *
+ * @param revid REVID reported by every simulated community.
+ * @return The controller, ready for interrupt registration, or %NULL.
+ */
+VoodooGPIO *VoodooGPIOBenchmark::createSimulatedController(const struct intel_pinctrl_soc_data *soc, UInt32 revid,
+                                                           VoodooGPIOSimulatedPCH *pch) {
+    VoodooGPIO *gpio = OSTypeAlloc(VoodooGPIO);
+    if (!gpio || !gpio->init()) {
+        OSSafeReleaseNULL(gpio);
+        return NULL;
+    }
+
+    gpio->intel_pinctrl_set_soc_data(soc);
+    gpio->pctl.nub = gpio;
+
+    /* Client calls run on the gate, as on the live controller */
+    gpio->command_gate = IOCommandGate::commandGate(gpio);
+    if (!gpio->getWorkLoop() || !gpio->command_gate ||
+        gpio->workLoop->addEventSource(gpio->command_gate) != kIOReturnSuccess ||
+        !pch->attach(&gpio->pctl, soc, revid)) {
+        destroySimulatedController(gpio, pch);
+        return NULL;
+    }
+    gpio->controllerIsAwake = true;
+    gpio->intel_gpio_storm_init();
+
+    /*
+     * Measure dispatch, not throttling of handler pins. Counting pins keep
+     * their production limit, so CountingPin shows whether a fast counter
+     * gets throttled.
+     */
+    gpio->pctl.storm_threshold = 0xffffffff;
+    return gpio;
+}
+
+void VoodooGPIOBenchmark::destroySimulatedController(VoodooGPIO *gpio, VoodooGPIOSimulatedPCH *pch) {
+    pch->detach(&gpio->pctl);
+    if (gpio->command_gate) {
+        if (gpio->workLoop)
+            gpio->workLoop->removeEventSource(gpio->command_gate);
+        OSSafeReleaseNULL(gpio->command_gate);
+    }
+    OSSafeReleaseNULL(gpio->workLoop);
+    gpio->release();
+}
+
+/**
+ * The community interrupt handler as it was before pending bits were walked
+ * directly, kept as the reference the current loop is measured against:
+ * GPI_IS and GPI_IE of every pad group of every community are read, each of
+ * the 32 bits is tested, and fired level pins are acknowledged one at a time
+ * with a GPI_IS write and a GPI_IE read-modify-write.
+ */
+void VoodooGPIOBenchmark::baselineDispatch(VoodooGPIO *gpio) {
+    for (int c = 0; c < gpio->pctl.ncommunities; c++) {
+        const struct intel_community *community = &gpio->pctl.communities[c];
+
+        for (unsigned gpp = 0; gpp < community->ngpps; gpp++) {
+            const struct intel_padgroup *padgrp = &community->gpps[gpp];
+            IOVirtualAddress is_reg = community->regs + GPI_IS + padgrp->reg_num * 4;
+            IOVirtualAddress ie_reg = community->regs + community->ie_offset + padgrp->reg_num * 4;
+            UInt32 pending, enabled;
+
+            pending = intel_readl(&gpio->pctl, is_reg, __func__);
+            enabled = intel_readl(&gpio->pctl, ie_reg, __func__);
+            pending &= enabled;
+
+            unsigned padno = padgrp->base - community->pin_base;
+            if (padno >= community->npins)
+                break;
+
+            for (int i = 0; i < 32; i++) {
+                if (!((pending >> i) & 0x1) || padno + i >= community->npins)
+                    continue;
+
+                const struct intel_pin_irq *irq = &community->irqs[padno + i];
+                if (irq->owner)
+                    irq->handler(irq->owner, irq->refcon, gpio, padno + i);
+
+                if (irq->type & IRQ_TYPE_LEVEL_MASK) {
+                    intel_writel(&gpio->pctl, BIT(i), is_reg, __func__);
+                    intel_writel(&gpio->pctl, intel_readl(&gpio->pctl, ie_reg, __func__) | BIT(i), ie_reg, __func__);
+                }
+            }
+        }
+    }
+}
+
+/**
+ * Register the pins of @scenario, then raise them and run the interrupt
+ * path @iterations times. Only the filter and gated handler are timed.
+ * The dispatch latency is the time from entering the interrupt path to the
+ * handler call of the first registered pin; it leaves out the work loop
+ * wakeup a gated dispatch also pays, see runWakeupLatency() for that.
+ *
+ * @param npins Number of pins registered by kScenarioPending.
+ * @param baseline Time baselineDispatch() instead of the interrupt path.
+ */
+OSDictionary *VoodooGPIOBenchmark::runScenario(VoodooGPIO *gpio, VoodooGPIOSimulatedPCH *pch, unsigned scenario, UInt32 iterations,
+                                               unsigned npins, bool baseline) {
+    struct intel_bench_pin *pins;
+    struct intel_bench_gpp *gpps;
+    struct intel_bench_pin *timed = NULL;
+    UInt64 dispatched = 0, elapsed = 0, latency = 0, ns, latency_ns, storms;
+    OSDictionary *result = NULL;
+    unsigned registered = 0;
+    int counted = -1;
+
+    pins = (struct intel_bench_pin *)IOMalloc(gpio->pctl.npin_map * sizeof(struct intel_bench_pin));
+    gpps = (struct intel_bench_gpp *)IOMalloc(gpio->pctl.total_gpps * sizeof(struct intel_bench_gpp));
+    if (!pins || !gpps)
+        goto out;
+    bzero(pins, gpio->pctl.npin_map * sizeof(struct intel_bench_pin));
+    bzero(gpps, gpio->pctl.total_gpps * sizeof(struct intel_bench_gpp));
+
+    for (unsigned offset = 0; offset < gpio->pctl.ngpio_map; offset++) {
+        const struct intel_pin_map *map = &gpio->pctl.gpio_map[offset];
+        if (map->community == INTEL_PIN_MAP_NONE)
+            continue;
+
+        const struct intel_community *community = &gpio->pctl.communities[map->community];
+        struct intel_bench_pin *pin = &pins[map->pin];
+        unsigned idx = map->padgroup;
+
+        for (int i = 0; i < map->community; i++)
+            idx += gpio->pctl.communities[i].ngpps;
+
+        pin->pch = pch;
+        pin->dispatched = &dispatched;
+        pin->community = map->community;
+        pin->reg = community->gpps[map->padgroup].reg_num;
+        pin->mask = BIT(map->offset);
+        pin->level = scenario == kScenarioMixed && (offset & 1);
+
+        if (scenario == kScenarioCounting) {
+            if (gpio->registerEdgeCounter(offset, gpio) != kIOReturnSuccess)
+                continue;
+            counted = offset;
+        } else if (scenario == kScenarioFilterPin) {
+            if (gpio->registerFilterInterrupt(offset, gpio, intel_bench_handler, pin) != kIOReturnSuccess)
+                continue;
+        } else if (gpio->registerInterrupt(offset, gpio, intel_bench_handler, pin) != kIOReturnSuccess) {
+            continue;
+        }
+        pin->registered = true;
+        if (!timed)
+            timed = pin;
+        gpio->setInterruptTypeForPin(offset, pin->level ? IRQ_TYPE_LEVEL_HIGH : IRQ_TYPE_EDGE_RISING);
+        gpio->enableInterrupt(offset);
+
+        gpps[idx].community = pin->community;
+        gpps[idx].reg = pin->reg;
+        if (pin->level)
+            gpps[idx].level |= pin->mask;
+        else
+            gpps[idx].edge |= pin->mask;
+
+        if (scenario == kScenarioSinglePin || scenario == kScenarioCounting || scenario == kScenarioFilterPin)
+            break;
+        if (scenario == kScenarioPending && ++registered == npins)
+            break;
+    }
+
+    pch->reads = 0;
+    pch->writes = 0;
+    storms = gpio->pctl.stats.storm_events;
+
+    for (UInt32 i = 0; i < iterations; i++) {
+        for (size_t j = 0; j < gpio->pctl.total_gpps; j++) {
+            if (gpps[j].edge)
+                pch->raise(gpps[j].community, gpps[j].reg, gpps[j].edge);
+            if (gpps[j].level)
+                pch->setLevel(gpps[j].community, gpps[j].reg, gpps[j].level, true);
+        }
+
+        UInt64 start = mach_absolute_time();
+        if (baseline)
+            baselineDispatch(gpio);
+        else if (gpio->interruptFilter(gpio, NULL))
+            gpio->interruptOccurredGated();
+        elapsed += mach_absolute_time() - start;
+
+        if (timed && timed->handled > start)
+            latency += timed->handled - start;
+    }
+
+    /* The baseline loop never acknowledged edge pins */
+    for (size_t j = 0; baseline && j < gpio->pctl.total_gpps; j++) {
+        if (gpps[j].edge)
+            intel_writel(&gpio->pctl, gpps[j].edge,
+                         gpio->pctl.communities[gpps[j].community].regs + GPI_IS + gpps[j].reg * 4, __func__);
+    }
+
+    /* Counting pins never call the handler, their edges are in the counter */
+    if (counted >= 0) {
+        UInt64 count;
+        if (gpio->readEdgeCounter(counted, &count, true) == kIOReturnSuccess)
+            dispatched += count;
+    }
+
+    absolutetime_to_nanoseconds(elapsed, &ns);
+    absolutetime_to_nanoseconds(latency, &latency_ns);
+
+    result = OSDictionary::withCapacity(8);
+    if (result) {
+        intel_bench_set(result, "Iterations", iterations);
+        intel_bench_set(result, "DispatchedPins", dispatched);
+        intel_bench_set(result, "ElapsedNS", ns);
+        intel_bench_set(result, "InterruptsPerSec", ns ? (UInt64)iterations * 1000000000ULL / ns : 0);
+        intel_bench_set(result, "NsPerPin", dispatched ? ns / dispatched : 0);
+        intel_bench_set(result, "DispatchLatencyNS", latency_ns / iterations);
+        intel_bench_set(result, "MMIOReadsPerInterrupt", pch->reads / iterations);
+        intel_bench_set(result, "MMIOWritesPerInterrupt", pch->writes / iterations);
+        intel_bench_set(result, "StormEvents", gpio->pctl.stats.storm_events - storms);
+    }
+
+    for (unsigned offset = 0; offset < gpio->pctl.ngpio_map; offset++) {
+        const struct intel_pin_map *map = &gpio->pctl.gpio_map[offset];
+        if (map->community != INTEL_PIN_MAP_NONE && pins[map->pin].registered)
+            gpio->unregisterInterrupt(offset);
+    }
+
+out:
+    if (gpps)
+        IOFree(gpps, gpio->pctl.total_gpps * sizeof(struct intel_bench_gpp));
+    if (pins)
+        IOFree(pins, gpio->pctl.npin_map * sizeof(struct intel_bench_pin));
+    return result;
+}
+
+/**
+ * Register every mapped pin, then run intel_pinctrl_suspend() and
+ * intel_pinctrl_resume() @iterations times. Each is timed on its own, as
+ * is the critical part of a deferred resume, before pins are re-armed.
+ */
+OSDictionary *VoodooGPIOBenchmark::runSuspendResume(VoodooGPIO *gpio, VoodooGPIOSimulatedPCH *pch, UInt32 iterations) {
+    UInt64 suspend = 0, resume = 0, deferred = 0, ns;
+    UInt64 suspend_reads = 0, suspend_writes = 0, resume_reads = 0, resume_writes = 0;
+    OSDictionary *result;
+
+    for (unsigned offset = 0; offset < gpio->pctl.ngpio_map; offset++) {
+        if (gpio->pctl.gpio_map[offset].community == INTEL_PIN_MAP_NONE)
+            continue;
+        if (gpio->registerInterrupt(offset, gpio, intel_bench_handler, NULL) != kIOReturnSuccess)
+            continue;
+        gpio->setInterruptTypeForPin(offset, IRQ_TYPE_EDGE_RISING);
+        gpio->enableInterrupt(offset);
+    }
+
+    for (UInt32 i = 0; i < iterations; i++) {
+        pch->reads = 0;
+        pch->writes = 0;
+
+        UInt64 start = mach_absolute_time();
+        intel_pinctrl_suspend(&gpio->pctl);
+        UInt64 mid = mach_absolute_time();
+        suspend += mid - start;
+        suspend_reads += pch->reads;
+        suspend_writes += pch->writes;
+        pch->reads = 0;
+        pch->writes = 0;
+
+        intel_pinctrl_resume(&gpio->pctl, false);
+        resume += mach_absolute_time() - mid;
+        resume_reads += pch->reads;
+        resume_writes += pch->writes;
+
+        intel_pinctrl_suspend(&gpio->pctl);
+        start = mach_absolute_time();
+        intel_pinctrl_resume(&gpio->pctl, true);
+        deferred += mach_absolute_time() - start;
+        intel_pinctrl_rearm_pending(&gpio->pctl);
+    }
+
+    result = OSDictionary::withCapacity(8);
+    if (result) {
+        intel_bench_set(result, "Iterations", iterations);
+        absolutetime_to_nanoseconds(suspend, &ns);
+        intel_bench_set(result, "SuspendNS", ns / iterations);
+        absolutetime_to_nanoseconds(resume, &ns);
+        intel_bench_set(result, "ResumeNS", ns / iterations);
+        absolutetime_to_nanoseconds(deferred, &ns);
+        intel_bench_set(result, "DeferredResumeNS", ns / iterations);
+        intel_bench_set(result, "MMIOReadsPerSuspend", suspend_reads / iterations);
+        intel_bench_set(result, "MMIOWritesPerSuspend", suspend_writes / iterations);
+        intel_bench_set(result, "MMIOReadsPerResume", resume_reads / iterations);
+        intel_bench_set(result, "MMIOWritesPerResume", resume_writes / iterations);
+    }
+
+    for (unsigned offset = 0; offset < gpio->pctl.ngpio_map; offset++) {
+        if (gpio->pctl.gpio_map[offset].community != INTEL_PIN_MAP_NONE)
+            gpio->unregisterInterrupt(offset);
+    }
+    return result;
+}
+
+/**
+ * Time from a latched GPI_IS bit to handler entry of one edge pin through
+ * the real interrupt path. The filter runs as the primary interrupt handler
+ * of an event source would, and when it defers, a provider-less filter event
+ * source on the scratch controller's work loop is signalled, so a gated pin
+ * pays for the work loop wakeup and the gate as it does on hardware.
+ *
+ * @param filter Register the pin with registerFilterInterrupt() instead of
+ *               registerInterrupt().
+ * @param iterations Capped at kBenchmarkWakeupIterations.
+ */
+OSDictionary *VoodooGPIOBenchmark::runWakeupLatency(VoodooGPIO *gpio, VoodooGPIOSimulatedPCH *pch, bool filter, UInt32 iterations) {
+    struct intel_bench_pin pin;
+    UInt64 dispatched = 0, total = 0, worst = 0, timeout, ns;
+    UInt32 completed = 0, timeouts = 0;
+    OSDictionary *result = NULL;
+    unsigned offset;
+    IOReturn ret;
+
+    for (offset = 0; offset < gpio->pctl.ngpio_map; offset++) {
+        if (gpio->pctl.gpio_map[offset].community != INTEL_PIN_MAP_NONE)
+            break;
+    }
+    if (offset == gpio->pctl.ngpio_map)
+        return NULL;
+
+    IOFilterInterruptEventSource *src = IOFilterInterruptEventSource::filterInterruptEventSource(gpio,
+        OSMemberFunctionCast(IOInterruptEventAction, gpio, &VoodooGPIO::InterruptOccurred),
+        OSMemberFunctionCast(IOFilterInterruptAction, gpio, &VoodooGPIO::interruptFilter), NULL);
+    if (!src)
+        return NULL;
+    if (gpio->workLoop->addEventSource(src) != kIOReturnSuccess) {
+        src->release();
+        return NULL;
+    }
+    src->enable();
+
+    const struct intel_pin_map *map = &gpio->pctl.gpio_map[offset];
+    bzero(&pin, sizeof(pin));
+    pin.pch = pch;
+    pin.dispatched = &dispatched;
+    pin.community = map->community;
+    pin.reg = gpio->pctl.communities[map->community].gpps[map->padgroup].reg_num;
+    pin.mask = BIT(map->offset);
+
+    if (filter)
+        ret = gpio->registerFilterInterrupt(offset, gpio, intel_bench_handler, &pin);
+    else
+        ret = gpio->registerInterrupt(offset, gpio, intel_bench_handler, &pin);
+    if (ret != kIOReturnSuccess)
+        goto out;
+    gpio->setInterruptTypeForPin(offset, IRQ_TYPE_EDGE_RISING);
+    gpio->enableInterrupt(offset);
+
+    nanoseconds_to_absolutetime(kBenchmarkWakeupTimeoutMS * kMillisecondScale, &timeout);
+    iterations = min(iterations, kBenchmarkWakeupIterations);
+
+    for (UInt32 i = 0; i < iterations; i++) {
+        pch->raise(pin.community, pin.reg, pin.mask);
+
+        UInt64 start = mach_absolute_time();
+        if (gpio->interruptFilter(gpio, src))
+            src->signalInterrupt();
+
+        UInt64 handled;
+        while ((handled = *(volatile UInt64 *)&pin.handled) < start) {
+            if (mach_absolute_time() - start > timeout)
+                break;
+            IODelay(1);
+        }
+
+        if (handled >= start) {
+            total += handled - start;
+            worst = max(worst, handled - start);
+            completed++;
+        } else {
+            timeouts++;
+        }
+
+        /* Let the gated pass finish before the next edge is latched */
+        gpio->command_gate->runAction(intel_bench_sync);
+    }
+
+    result = OSDictionary::withCapacity(4);
+    if (result) {
+        intel_bench_set(result, "Iterations", iterations);
+        absolutetime_to_nanoseconds(completed ? total / completed : 0, &ns);
+        intel_bench_set(result, "WakeupLatencyNS", ns);
+        absolutetime_to_nanoseconds(worst, &ns);
+        intel_bench_set(result, "MaxWakeupLatencyNS", ns);
+        intel_bench_set(result, "Timeouts", timeouts);
+    }
+
+    gpio->unregisterInterrupt(offset);
+
+out:
+    src->disable();
+    gpio->workLoop->removeEventSource(src);
+    src->release();
+    return result;
+}
+
+/**
+ * Time the current dispatch loop and baselineDispatch() with @npins edge
+ * pins pending on every interrupt.
+ *
+ * @return "Current" and "Baseline" results of kScenarioPending.
+ */
+OSDictionary *VoodooGPIOBenchmark::runLoopComparison(VoodooGPIO *gpio, VoodooGPIOSimulatedPCH *pch, unsigned npins, UInt32 iterations) {
+    OSDictionary *result = OSDictionary::withCapacity(2);
+    if (!result)
+        return NULL;
+
+    for (int baseline = 0; baseline < 2; baseline++) {
+        OSDictionary *loop = runScenario(gpio, pch, kScenarioPending, iterations, npins, baseline);
+        if (loop) {
+            result->setObject(baseline ? "Baseline" : "Current", loop);
+            loop->release();
+        }
+    }
+    return result;
+}
+
+OSDictionary *VoodooGPIOBenchmark::runPlatform(const struct intel_pinctrl_soc_data *soc, UInt32 revid, UInt32 iterations) {
+    VoodooGPIOSimulatedPCH pch;
+    VoodooGPIO *gpio;
+    OSDictionary *results;
+
+    gpio = createSimulatedController(soc, revid, &pch);
+    if (!gpio)
+        return NULL;
+
+    results = OSDictionary::withCapacity(kScenarioCount + 3);
+    for (unsigned scenario = 0; results && scenario < kScenarioCount; scenario++) {
+        OSDictionary *result = runScenario(gpio, &pch, scenario, iterations);
+        if (result) {
+            results->setObject(bench_scenario_names[scenario], result);
+            result->release();
+        }
+    }
+
+    OSDictionary *loops = results ? OSDictionary::withCapacity(ARRAY_SIZE(bench_loop_pending)) : NULL;
+    for (int i = 0; loops && i < ARRAY_SIZE(bench_loop_pending); i++) {
+        OSDictionary *result = runLoopComparison(gpio, &pch, bench_loop_pending[i], iterations);
+        char key[16];
+
+        snprintf(key, sizeof(key), "Pending%u", bench_loop_pending[i]);
+        if (result) {
+            loops->setObject(key, result);
+            result->release();
+        }
+    }
+    if (loops) {
+        results->setObject("DispatchLoop", loops);
+        loops->release();
+    }
+
+    OSDictionary *wakeup = results ? OSDictionary::withCapacity(2) : NULL;
+    for (int filter = 0; wakeup && filter < 2; filter++) {
+        OSDictionary *result = runWakeupLatency(gpio, &pch, filter, iterations);
+        if (result) {
+            wakeup->setObject(filter ? "Filter" : "Gated", result);
+            result->release();
+        }
+    }
+    if (wakeup) {
+        results->setObject("WakeupLatency", wakeup);
+        wakeup->release();
+    }
+
+    if (results) {
+        OSDictionary *result = runSuspendResume(gpio, &pch, iterations);
+        if (result) {
+            results->setObject("SuspendResume", result);
+            result->release();
+        }
+    }
+
+    destroySimulatedController(gpio, &pch);
+    return results;
+}
+
+/**
+ * Run every scenario on every platform table.
+ *
+ * @param iterations Interrupts per scenario, %0 for the default. Capped at
+ *                   kBenchmarkMaxIterations, as the caller blocks until done.
+ * @return Results keyed by platform and scenario.
+ */
+OSDictionary *VoodooGPIOBenchmark::run(UInt32 iterations) {
+    OSDictionary *results;
+
+    if (!iterations)
+        iterations = kBenchmarkDefaultIterations;
+    iterations = min(iterations, kBenchmarkMaxIterations);
+
+    results = OSDictionary::withCapacity(ARRAY_SIZE(bench_platforms));
+    if (!results)
+        return NULL;
+
+    for (int i = 0; i < ARRAY_SIZE(bench_platforms); i++) {
+        OSDictionary *platform = runPlatform(bench_platforms[i].soc, bench_platforms[i].revid, iterations);
+        if (platform) {
+            results->setObject(bench_platforms[i].soc->name, platform);
+            platform->release();
+        }
+    }
+    return results;
+}
+
+#endif /* VOODOOGPIO_BENCHMARK */
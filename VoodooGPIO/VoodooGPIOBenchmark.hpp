@@ -0,0 +1,51 @@
+//
+//  VoodooGPIOBenchmark.hpp
+//  VoodooGPIO
+//
+
+#ifndef VoodooGPIOBenchmark_h
+#define VoodooGPIOBenchmark_h
+
+#ifdef VOODOOGPIO_BENCHMARK
+
+#include "VoodooGPIO.hpp"
+
+class VoodooGPIOSimulatedPCH;
+
+#define kBenchmarkKey               "RunDispatchBenchmark"
+#define kBenchmarkResultsKey        "DispatchBenchmark"
+#define kBenchmarkDefaultIterations 10000
+#define kBenchmarkMaxIterations     50000
+#define kBenchmarkWakeupIterations  1000
+#define kBenchmarkWakeupTimeoutMS   100
+
+/**
+ * Dispatch path benchmark (debug builds only).
+ *
+ * Each supported platform table is loaded into a scratch controller whose
+ * registers live in a VoodooGPIOSimulatedPCH, so the numbers cover the
+ * driver's own work plus a cheap in-memory register access rather than an
+ * uncached MMIO round trip. The live controller is never touched.
+ */
+class VoodooGPIOBenchmark {
+ public:
+    static OSDictionary *run(UInt32 iterations);
+
+    static const struct intel_pinctrl_soc_data *findPlatform(const char *name, UInt32 *revid);
+    static VoodooGPIO *createSimulatedController(const struct intel_pinctrl_soc_data *soc, UInt32 revid,
+                                                 VoodooGPIOSimulatedPCH *pch);
+    static void destroySimulatedController(VoodooGPIO *gpio, VoodooGPIOSimulatedPCH *pch);
+
+ private:
+    static OSDictionary *runPlatform(const struct intel_pinctrl_soc_data *soc, UInt32 revid, UInt32 iterations);
+    static OSDictionary *runScenario(VoodooGPIO *gpio, VoodooGPIOSimulatedPCH *pch, unsigned scenario, UInt32 iterations,
+                                     unsigned npins = 0, bool baseline = false);
+    static OSDictionary *runLoopComparison(VoodooGPIO *gpio, VoodooGPIOSimulatedPCH *pch, unsigned npins, UInt32 iterations);
+    static void baselineDispatch(VoodooGPIO *gpio);
+    static OSDictionary *runSuspendResume(VoodooGPIO *gpio, VoodooGPIOSimulatedPCH *pch, UInt32 iterations);
+    static OSDictionary *runWakeupLatency(VoodooGPIO *gpio, VoodooGPIOSimulatedPCH *pch, bool filter, UInt32 iterations);
+};
+
+#endif /* VOODOOGPIO_BENCHMARK */
+
+#endif /* VoodooGPIOBenchmark_h */
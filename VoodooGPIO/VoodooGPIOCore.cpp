@@ -0,0 +1,1649 @@
+//
+//  VoodooGPIOCore.cpp
+//  VoodooGPIO
+//
+
+#include "VoodooGPIOCore.hpp"
+#include "VoodooGPIORegisters.hpp"
+#include "linuxirq.h"
+
+#include <string.h>
+
+#ifdef VOODOOGPIO_HOST
+#include <stdlib.h>
+#include <time.h>
+
+/*
+ * The kernel services the core uses, for the host build. Absolute time is
+ * in nanoseconds there.
+ */
+#define kMillisecondScale 1000000ULL
+
+static inline uint64_t mach_absolute_time(void) {
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+static inline void nanoseconds_to_absolutetime(uint64_t ns, uint64_t *abs) {
+    *abs = ns;
+}
+
+static inline void absolutetime_to_nanoseconds(uint64_t abs, uint64_t *ns) {
+    *ns = abs;
+}
+
+static inline void *IOMalloc(size_t size) {
+    return malloc(size);
+}
+
+static inline void IOFree(void *ptr, size_t size) {
+    free(ptr);
+}
+
+static inline void *IOMallocAligned(size_t size, size_t align) {
+    void *ptr;
+    return posix_memalign(&ptr, align, size) ? NULL : ptr;
+}
+
+static inline void IOFreeAligned(void *ptr, size_t size) {
+    free(ptr);
+}
+
+static inline int64_t OSAddAtomic64(int64_t amount, volatile int64_t *addr) {
+    return __atomic_fetch_add(addr, amount, __ATOMIC_SEQ_CST);
+}
+
+static inline int32_t OSIncrementAtomic(volatile int32_t *addr) {
+    return __atomic_fetch_add(addr, 1, __ATOMIC_SEQ_CST);
+}
+
+static inline int32_t OSDecrementAtomic(volatile int32_t *addr) {
+    return __atomic_fetch_sub(addr, 1, __ATOMIC_SEQ_CST);
+}
+
+static inline uint32_t OSBitOrAtomic(uint32_t mask, volatile uint32_t *addr) {
+    return __atomic_fetch_or(addr, mask, __ATOMIC_SEQ_CST);
+}
+
+static inline uint32_t OSBitAndAtomic(uint32_t mask, volatile uint32_t *addr) {
+    return __atomic_fetch_and(addr, mask, __ATOMIC_SEQ_CST);
+}
+
+static inline void OSMemoryBarrier(void) {
+    __atomic_thread_fence(__ATOMIC_SEQ_CST);
+}
+
+static inline unsigned int min(unsigned int a, unsigned int b) {
+    return a < b ? a : b;
+}
+
+static inline unsigned int max(unsigned int a, unsigned int b) {
+    return a > b ? a : b;
+}
+#else
+#include <IOKit/IOLib.h>
+#endif
+
+/* Every register access is accounted to the calling function */
+#define readl(addr)         intel_readl(pctl, addr, __func__)
+#define writel(b, addr)     intel_writel(pctl, b, addr, __func__)
+
+/**
+ * Number of pad groups of a community: its custom @gpps, or pad groups of
+ * @gpp_size pins.
+ */
+size_t intel_community_count_padgroups(const struct intel_community *community) {
+    if (community->gpps)
+        return community->ngpps;
+    return DIV_ROUND_UP(community->npins, community->gpp_size);
+}
+
+/**
+ * Fill in the pad groups of a community, including the ones the core driver
+ * derives from @gpp_size, and assign their PAD_OWN registers.
+ *
+ * @param gpps intel_community_count_padgroups() entries.
+ * @return false if a pad group is larger than a register.
+ */
+bool intel_community_fill_padgroups(const struct intel_community *community, struct intel_padgroup *gpps, size_t ngpps) {
+    unsigned padown_num = 0;
+    size_t npins = community->npins;
+
+    for (size_t i = 0; i < ngpps; i++) {
+        if (community->gpps) {
+            gpps[i] = community->gpps[i];
+        } else {
+            unsigned gpp_size = community->gpp_size;
+            gpps[i].reg_num = (uint32_t)i;
+            gpps[i].base = (uint32_t)(community->pin_base + i * gpp_size);
+            gpps[i].size = (uint32_t)(gpp_size < npins ? gpp_size : npins);
+            gpps[i].gpio_base = 0;
+            npins -= gpps[i].size;
+        }
+
+        if (gpps[i].size > 32)
+            return false;
+
+        // Set gpio_base to base if not specified
+        if (!gpps[i].gpio_base)
+            gpps[i].gpio_base = gpps[i].base;
+
+        gpps[i].padown_num = padown_num;
+
+        /*
+         * In older hardware the number of padown registers per
+         * group is fixed regardless of the group size.
+         */
+        if (community->gpp_num_padown_regs)
+            padown_num += community->gpp_num_padown_regs;
+        else
+            padown_num += DIV_ROUND_UP(gpps[i].size * 4, 32);
+    }
+    return true;
+}
+
+/**
+ * Size the hardware pin and GPIO offset lookup tables of probed communities.
+ */
+void intel_pin_map_sizes(const struct intel_community *communities, size_t ncommunities,
+                         size_t *npin_map, size_t *ngpio_map) {
+    size_t max_pin = 0, max_gpio = 0;
+
+    for (size_t i = 0; i < ncommunities; i++) {
+        const struct intel_community *community = &communities[i];
+        if (community->pin_base + community->npins > max_pin)
+            max_pin = community->pin_base + community->npins;
+
+        for (size_t j = 0; j < community->ngpps; j++) {
+            const struct intel_padgroup *padgrp = &community->gpps[j];
+            if (padgrp->gpio_base >= 0 && (size_t)padgrp->gpio_base + padgrp->size > max_gpio)
+                max_gpio = padgrp->gpio_base + padgrp->size;
+        }
+    }
+
+    *npin_map = max_pin;
+    *ngpio_map = max_gpio;
+}
+
+/**
+ * Build the hardware pin and GPIO offset lookup tables. Pins that are not
+ * part of a pad group and GPIO offsets that fall into gaps (or pad groups
+ * without GPIO mapping) are left as %INTEL_PIN_MAP_NONE.
+ *
+ * @param npin_map Size of @pin_map, as returned by intel_pin_map_sizes().
+ * @param ngpio_map Size of @gpio_map, as returned by intel_pin_map_sizes().
+ */
+void intel_pin_map_fill(const struct intel_community *communities, size_t ncommunities,
+                        struct intel_pin_map *pin_map, size_t npin_map,
+                        struct intel_pin_map *gpio_map, size_t ngpio_map) {
+    memset(pin_map, INTEL_PIN_MAP_NONE, npin_map * sizeof(struct intel_pin_map));
+    memset(gpio_map, INTEL_PIN_MAP_NONE, ngpio_map * sizeof(struct intel_pin_map));
+
+    for (size_t i = 0; i < ncommunities; i++) {
+        const struct intel_community *community = &communities[i];
+
+        for (unsigned pin = community->pin_base; pin < community->pin_base + community->npins; pin++) {
+            pin_map[pin].pin = pin;
+            pin_map[pin].community = (uint8_t)i;
+        }
+
+        for (size_t j = 0; j < community->ngpps; j++) {
+            const struct intel_padgroup *padgrp = &community->gpps[j];
+
+            for (unsigned k = 0; k < padgrp->size; k++) {
+                struct intel_pin_map map = {
+                    .pin = (uint16_t)(padgrp->base + k),
+                    .community = (uint8_t)i,
+                    .padgroup = (uint8_t)j,
+                    .offset = (uint8_t)k,
+                };
+
+                if (map.pin >= npin_map)
+                    break;
+                pin_map[map.pin] = map;
+
+                if (padgrp->gpio_base >= 0)
+                    gpio_map[padgrp->gpio_base + k] = map;
+            }
+        }
+    }
+}
+
+/**
+ * Precompute the register locations of every pin. The community registers
+ * must be mapped, so that @pad_regs is known.
+ */
+void intel_pad_descs_fill(const struct intel_community *communities, const struct intel_pin_map *pin_map,
+                          size_t npin_map, struct intel_pad_desc *pad_descs) {
+    memset(pad_descs, 0, npin_map * sizeof(struct intel_pad_desc));
+
+    for (unsigned pin = 0; pin < npin_map; pin++) {
+        const struct intel_pin_map *map = &pin_map[pin];
+        struct intel_pad_desc *desc = &pad_descs[pin];
+
+        if (map->community == INTEL_PIN_MAP_NONE)
+            continue;
+
+        const struct intel_community *community = &communities[map->community];
+        bool debounce = community->features & PINCTRL_FEATURE_DEBOUNCE;
+        unsigned nregs = debounce ? 4 : 2;
+
+        desc->padcfg = (uint32_t)(community->pad_regs - community->regs) +
+                       (pin - community->pin_base) * nregs * 4;
+        if (debounce)
+            desc->flags |= INTEL_PAD_HAS_PADCFG2;
+
+        if (map->padgroup == INTEL_PIN_MAP_NONE)
+            continue;
+
+        const struct intel_padgroup *padgrp = &community->gpps[map->padgroup];
+
+        desc->flags |= INTEL_PAD_HAS_PADGROUP;
+        desc->mask = BIT(map->offset);
+        desc->is_reg = GPI_IS + padgrp->reg_num * 4;
+        desc->ie_reg = community->ie_offset + padgrp->reg_num * 4;
+
+        if (community->padown_offset) {
+            desc->padown = community->padown_offset + padgrp->padown_num * 4 +
+                           PADOWN_GPP(map->offset) * 4;
+            desc->padown_shift = PADOWN_SHIFT(map->offset);
+        }
+        if (community->hostown_offset)
+            desc->hostown = community->hostown_offset + padgrp->reg_num * 4;
+        if (community->padcfglock_offset)
+            desc->padcfglock = community->padcfglock_offset + padgrp->reg_num * 8;
+    }
+}
+
+/**
+ * @param pin Hardware pin number.
+ * @return Pad group of @pin in @community, %NULL if @pin is not part of a
+ *         pad group of @community.
+ */
+const struct intel_padgroup *intel_pin_map_padgroup(const struct intel_community *communities,
+                                                    const struct intel_pin_map *pin_map, size_t npin_map,
+                                                    const struct intel_community *community, unsigned pin) {
+    if (pin < npin_map && pin_map[pin].padgroup != INTEL_PIN_MAP_NONE &&
+        &communities[pin_map[pin].community] == community)
+        return &community->gpps[pin_map[pin].padgroup];
+    return NULL;
+}
+
+/**
+ * Encode a debounce time into the PADCFG2 debounce fields.
+ *
+ * @param debounce Debounce time in microseconds, %0 to disable.
+ * @param value Set to the PADCFG2_DEBEN and PADCFG2_DEBOUNCE_MASK bits.
+ * @return false if @debounce is longer than the hardware supports.
+ */
+bool intel_debounce_encode(uint32_t debounce, uint32_t *value) {
+    uint64_t ns = (uint64_t)debounce * 1000;
+    unsigned v;
+
+    *value = 0;
+    if (!debounce)
+        return true;
+
+    /* Supported periods are DEBOUNCE_PERIOD << 3 up to << 15 */
+    if (ns > (uint64_t)DEBOUNCE_PERIOD << 15)
+        return false;
+
+    /* Round to the nearest period; halfway between two rounds up */
+    for (v = 3; v < 15; v++) {
+        if (ns * 2 < (uint64_t)DEBOUNCE_PERIOD * 3 << v)
+            break;
+    }
+
+    *value = v << PADCFG2_DEBOUNCE_SHIFT | PADCFG2_DEBEN;
+    return true;
+}
+
+/**
+ * @return Community of hardware pin @pin, %NULL if @pin is not mapped.
+ */
+struct intel_community *intel_get_community(const struct intel_pinctrl *pctl, unsigned pin) {
+    if (pin < pctl->npin_map && pctl->pin_map[pin].community != INTEL_PIN_MAP_NONE)
+        return &pctl->communities[pctl->pin_map[pin].community];
+    return NULL;
+}
+
+uintptr_t intel_get_padcfg(const struct intel_pinctrl *pctl, unsigned pin, unsigned reg) {
+    const struct intel_community *community;
+    const struct intel_pad_desc *desc;
+
+    community = intel_get_community(pctl, pin);
+    if (!community)
+        return 0;
+
+    desc = &pctl->pad_descs[pin];
+    if (reg == PADCFG2 && !(desc->flags & INTEL_PAD_HAS_PADCFG2))
+        return 0;
+
+    return community->regs + desc->padcfg + reg;
+}
+
+bool intel_pad_owned_by_host(const struct intel_pinctrl *pctl, unsigned pin) {
+    const struct intel_community *community;
+    const struct intel_pad_desc *desc;
+
+    community = intel_get_community(pctl, pin);
+    if (!community)
+        return false;
+    if (!community->padown_offset)
+        return true;
+
+    desc = &pctl->pad_descs[pin];
+    if (!(desc->flags & INTEL_PAD_HAS_PADGROUP))
+        return false;
+
+    return !(readl(community->regs + desc->padown) & (0xf << desc->padown_shift));
+}
+
+bool intel_pad_acpi_mode(const struct intel_pinctrl *pctl, unsigned pin) {
+    const struct intel_community *community;
+    const struct intel_pad_desc *desc;
+
+    community = intel_get_community(pctl, pin);
+    if (!community)
+        return true;
+    if (!community->hostown_offset)
+        return false;
+
+    desc = &pctl->pad_descs[pin];
+    if (!(desc->flags & INTEL_PAD_HAS_PADGROUP))
+        return true;
+
+    return !(readl(community->regs + desc->hostown) & desc->mask);
+}
+
+bool intel_pad_locked(const struct intel_pinctrl *pctl, unsigned pin) {
+    const struct intel_community *community;
+    const struct intel_pad_desc *desc;
+
+    community = intel_get_community(pctl, pin);
+    if (!community)
+        return true;
+    if (!community->padcfglock_offset)
+        return false;
+
+    desc = &pctl->pad_descs[pin];
+    if (!(desc->flags & INTEL_PAD_HAS_PADGROUP))
+        return true;
+
+    /*
+     * If PADCFGLOCK and PADCFGLOCKTX bits are both clear for this pad,
+     * the pad is considered unlocked. Any other case means that it is
+     * either fully or partially locked and we don't touch it.
+     */
+    if (readl(community->regs + desc->padcfglock) & desc->mask)
+        return true;
+
+    if (readl(community->regs + desc->padcfglock + 4) & desc->mask)
+        return true;
+
+    return false;
+}
+
+/**
+ * Translate GPIO offset to hardware pin (They are not always the same).
+ * Putting appropriate community and padgroup in the variables.
+ *
+ * @param offset GPIO pin number.
+ * @param community Matching community for hardware pin number.
+ * @param padgrp Matching padgroup for hardware pin number.
+ * @return Hardware GPIO pin number. -1 if not found.
+ */
+int32_t intel_gpio_to_pin(const struct intel_pinctrl *pctl, uint32_t offset,
+                          const struct intel_community **community, const struct intel_padgroup **padgrp) {
+    if (offset < pctl->ngpio_map && pctl->gpio_map[offset].community != INTEL_PIN_MAP_NONE) {
+        const struct intel_pin_map *map = &pctl->gpio_map[offset];
+        const struct intel_community *comm = &pctl->communities[map->community];
+
+        if (community)
+            *community = comm;
+        if (padgrp)
+            *padgrp = &comm->gpps[map->padgroup];
+        return map->pin;
+    }
+    return -1;
+}
+
+/**
+ * @param pin Hardware GPIO pin number to enable.
+ */
+void intel_gpio_irq_enable(struct intel_pinctrl *pctl, unsigned pin) {
+    const struct intel_community *community = intel_get_community(pctl, pin);
+    if (community) {
+        const struct intel_pad_desc *desc = &pctl->pad_descs[pin];
+        if (!(desc->flags & INTEL_PAD_HAS_PADGROUP))
+            return;
+
+        unsigned gpp = pctl->pin_map[pin].padgroup;
+
+        /* Clear interrupt status first to avoid unexpected interrupt */
+        writel(desc->mask, community->regs + desc->is_reg);
+
+        /* A throttled pin is unmasked by the storm timer once it expires */
+        if (community->gpp_state[gpp].throttled & desc->mask)
+            return;
+
+        intel_gpio_write_ie(pctl, community, gpp, community->gpp_state[gpp].ie | desc->mask);
+    }
+}
+
+/**
+ * @param pin Hardware GPIO pin number to mask.
+ * @param mask Whether to mask or unmask.
+ */
+void intel_gpio_irq_mask_unmask(struct intel_pinctrl *pctl, unsigned pin, bool mask) {
+    const struct intel_community *community = intel_get_community(pctl, pin);
+    if (community) {
+        const struct intel_pad_desc *desc = &pctl->pad_descs[pin];
+        if (!(desc->flags & INTEL_PAD_HAS_PADGROUP))
+            return;
+
+        unsigned gpp = pctl->pin_map[pin].padgroup;
+        uint32_t value;
+
+        value = community->gpp_state[gpp].ie;
+        if (mask) {
+            value &= ~desc->mask;
+            community->gpp_state[gpp].throttled &= ~desc->mask;
+        } else if (!(community->gpp_state[gpp].throttled & desc->mask)) {
+            value |= desc->mask;
+        }
+        intel_gpio_write_ie(pctl, community, gpp, value);
+    }
+}
+
+/**
+ * Update the GPI_IE shadow of a pad group, touching hardware only on change.
+ *
+ * @param community Community the pad group belongs to.
+ * @param gpp Index of the pad group in @community->gpps.
+ * @param value New interrupt enable mask.
+ */
+void intel_gpio_write_ie(struct intel_pinctrl *pctl, const struct intel_community *community, unsigned gpp,
+                         uint32_t value) {
+    if (community->gpp_state[gpp].ie == value)
+        return;
+
+    community->gpp_state[gpp].ie = value;
+    writel(value, community->regs + community->ie_offset + community->gpps[gpp].reg_num * 4);
+    intel_gpio_update_active(pctl, community, gpp);
+}
+
+/**
+ * Recompute whether a pad group has registered pins that are enabled, and
+ * with it whether its community needs scanning on interrupt.
+ *
+ * @param community Community the pad group belongs to.
+ * @param gpp Index of the pad group in @community->gpps.
+ */
+void intel_gpio_update_active(struct intel_pinctrl *pctl, const struct intel_community *community, unsigned gpp) {
+    unsigned idx = (unsigned)(community - pctl->communities);
+    struct intel_community *comm = &pctl->communities[idx];
+    const struct intel_padgroup_state *state = &comm->gpp_state[gpp];
+
+    if (state->ie & state->registered)
+        comm->active_gpps |= BIT(gpp);
+    else
+        comm->active_gpps &= ~BIT(gpp);
+
+    if (comm->active_gpps)
+        pctl->active_communities |= BIT(idx);
+    else
+        pctl->active_communities &= ~BIT(idx);
+}
+
+/**
+ * Reload every GPI_IE shadow from hardware (e.g. after firmware ran on resume).
+ */
+void intel_gpio_sync_ie(struct intel_pinctrl *pctl) {
+    for (size_t i = 0; i < pctl->ncommunities; i++) {
+        struct intel_community *community = &pctl->communities[i];
+        if (!community->gpp_state)
+            continue;
+
+        for (unsigned gpp = 0; gpp < community->ngpps; gpp++) {
+            community->gpp_state[gpp].ie = readl(community->regs + community->ie_offset +
+                                                 community->gpps[gpp].reg_num * 4);
+            intel_gpio_update_active(pctl, community, gpp);
+        }
+    }
+}
+
+/**
+ * @param pin Hardware GPIO pin number to set its type.
+ * @param type Type to set.
+ * @return false if the pin has no pad or is in ACPI mode.
+ */
+bool intel_gpio_irq_set_type(struct intel_pinctrl *pctl, unsigned pin, unsigned type) {
+    uintptr_t reg;
+    uint32_t value;
+
+    reg = intel_get_padcfg(pctl, pin, PADCFG0);
+    if (!reg)
+        return false;
+
+    /*
+     * If the pin is in ACPI mode it is still usable as a GPIO but it
+     * cannot be used as IRQ because GPI_IS status bit will not be
+     * updated by the host controller hardware.
+     */
+    if (intel_pad_acpi_mode(pctl, pin))
+        return false;
+
+    value = readl(reg);
+
+    value &= ~(PADCFG0_RXEVCFG_MASK | PADCFG0_RXINV);
+
+    if ((type & IRQ_TYPE_EDGE_BOTH) == IRQ_TYPE_EDGE_BOTH) {
+        value |= PADCFG0_RXEVCFG_EDGE_BOTH << PADCFG0_RXEVCFG_SHIFT;
+    } else if (type & IRQ_TYPE_EDGE_FALLING) {
+        value |= PADCFG0_RXEVCFG_EDGE << PADCFG0_RXEVCFG_SHIFT;
+        value |= PADCFG0_RXINV;
+    } else if (type & IRQ_TYPE_EDGE_RISING) {
+        value |= PADCFG0_RXEVCFG_EDGE << PADCFG0_RXEVCFG_SHIFT;
+    } else if (type & IRQ_TYPE_LEVEL_MASK) {
+        if (type & IRQ_TYPE_LEVEL_LOW)
+            value |= PADCFG0_RXINV;
+    } else {
+        value |= PADCFG0_RXEVCFG_DISABLED << PADCFG0_RXEVCFG_SHIFT;
+    }
+
+    writel(value, reg);
+    intel_gpio_drop_tx_shadow(pctl, pin);
+    return true;
+}
+
+/**
+ * Forget the PADCFG0 shadow of a pin after PADCFG0 was written otherwise.
+ *
+ * @param pin Hardware GPIO pin number.
+ */
+void intel_gpio_drop_tx_shadow(struct intel_pinctrl *pctl, unsigned pin) {
+    if (pctl->pad_descs[pin].flags & INTEL_PAD_HAS_PADGROUP) {
+        const struct intel_pin_map *map = &pctl->pin_map[pin];
+        pctl->communities[map->community].gpp_state[map->padgroup].tx_shadowed &= ~pctl->pad_descs[pin].mask;
+    }
+}
+
+static bool intel_pinctrl_add_padgroups(struct intel_pinctrl *pctl, struct intel_community *community) {
+    struct intel_padgroup *gpps;
+    size_t ngpps = intel_community_count_padgroups(community);
+
+    gpps = (struct intel_padgroup *)IOMalloc(ngpps * sizeof(struct intel_padgroup));
+    if (!gpps)
+        return false;
+
+    if (!intel_community_fill_padgroups(community, gpps, ngpps)) {
+        IOFree(gpps, ngpps * sizeof(struct intel_padgroup));
+        return false;
+    }
+
+    community->gpps = gpps;
+    community->ngpps = ngpps;
+    community->gpps_alloc = true;
+    return true;
+}
+
+/**
+ * Set up a community whose registers are reachable at @regs: detect its
+ * features, locate the pad configuration registers and add the pad groups.
+ *
+ * @return false if the pad groups could not be added.
+ */
+bool intel_pinctrl_probe_community(struct intel_pinctrl *pctl, struct intel_community *community, uintptr_t regs) {
+    community->regs = regs;
+
+    /*
+     * Determine community features based on the revision if
+     * not specified already.
+     */
+    if (!community->features) {
+        uint32_t rev;
+        rev = (readl(regs + REVID) & REVID_MASK) >> REVID_SHIFT;
+        if (rev >= 0x94) {
+            community->features |= PINCTRL_FEATURE_DEBOUNCE;
+            community->features |= PINCTRL_FEATURE_1K_PD;
+        }
+    }
+
+    /* Read offset of the pad configuration registers */
+    uint32_t padbar = readl(regs + PADBAR);
+
+    community->pad_regs = regs + padbar;
+
+    return intel_pinctrl_add_padgroups(pctl, community);
+}
+
+static void intel_pinctrl_release_pin_maps(struct intel_pinctrl *pctl) {
+    if (pctl->pad_descs) {
+        IOFree(pctl->pad_descs, pctl->npin_map * sizeof(struct intel_pad_desc));
+        pctl->pad_descs = NULL;
+    }
+
+    if (pctl->pin_map) {
+        IOFree(pctl->pin_map, pctl->npin_map * sizeof(struct intel_pin_map));
+        pctl->pin_map = NULL;
+    }
+    pctl->npin_map = 0;
+
+    if (pctl->gpio_map) {
+        IOFree(pctl->gpio_map, pctl->ngpio_map * sizeof(struct intel_pin_map));
+        pctl->gpio_map = NULL;
+    }
+    pctl->ngpio_map = 0;
+}
+
+static bool intel_pinctrl_build_pin_maps(struct intel_pinctrl *pctl) {
+    intel_pin_map_sizes(pctl->communities, pctl->ncommunities, &pctl->npin_map, &pctl->ngpio_map);
+
+    pctl->pin_map = (struct intel_pin_map *)IOMalloc(pctl->npin_map * sizeof(struct intel_pin_map));
+    pctl->gpio_map = (struct intel_pin_map *)IOMalloc(pctl->ngpio_map * sizeof(struct intel_pin_map));
+    pctl->pad_descs = (struct intel_pad_desc *)IOMalloc(pctl->npin_map * sizeof(struct intel_pad_desc));
+    if (!pctl->pin_map || !pctl->gpio_map || !pctl->pad_descs) {
+        intel_pinctrl_release_pin_maps(pctl);
+        return false;
+    }
+
+    intel_pin_map_fill(pctl->communities, pctl->ncommunities, pctl->pin_map, pctl->npin_map,
+                       pctl->gpio_map, pctl->ngpio_map);
+    intel_pad_descs_fill(pctl->communities, pctl->pin_map, pctl->npin_map, pctl->pad_descs);
+    return true;
+}
+
+/**
+ * Allocate the lookup tables and interrupt state of every community. The
+ * communities must have been probed. On failure, whatever was allocated
+ * is left for intel_pinctrl_release_state().
+ */
+bool intel_pinctrl_alloc_state(struct intel_pinctrl *pctl) {
+    pctl->total_gpps = 0;
+    for (size_t i = 0; i < pctl->ncommunities; i++)
+        pctl->total_gpps += pctl->communities[i].ngpps;
+
+    if (!intel_pinctrl_build_pin_maps(pctl))
+        return false;
+
+    pctl->tx_shadow = (uint32_t *)IOMalloc(pctl->npin_map * sizeof(uint32_t));
+    if (!pctl->tx_shadow)
+        return false;
+
+    pctl->npin_irqs = 0;
+    for (size_t i = 0; i < pctl->ncommunities; i++)
+        pctl->npin_irqs += pctl->communities[i].npins;
+
+    pctl->pin_irqs = (struct intel_pin_irq *)IOMallocAligned(pctl->npin_irqs * sizeof(struct intel_pin_irq),
+                                                             sizeof(struct intel_pin_irq));
+    if (!pctl->pin_irqs)
+        return false;
+    memset(pctl->pin_irqs, 0, pctl->npin_irqs * sizeof(struct intel_pin_irq));
+
+#ifdef VOODOOGPIO_LATENCY_STATS
+    pctl->pin_latency = (struct intel_pin_latency *)IOMalloc(pctl->npin_irqs * sizeof(struct intel_pin_latency));
+    if (!pctl->pin_latency)
+        return false;
+    memset(pctl->pin_latency, 0, pctl->npin_irqs * sizeof(struct intel_pin_latency));
+#endif
+
+    for (size_t i = 0, idx = 0; i < pctl->ncommunities; i++) {
+        struct intel_community *community = &pctl->communities[i];
+
+        community->irqs = &pctl->pin_irqs[idx];
+        idx += community->npins;
+
+        size_t sz = sizeof(struct intel_padgroup_state) * community->ngpps;
+        community->gpp_state = (struct intel_padgroup_state *)IOMalloc(sz);
+        if (!community->gpp_state)
+            return false;
+        memset(community->gpp_state, 0, sz);
+    }
+
+    intel_gpio_sync_ie(pctl);
+    return true;
+}
+
+void intel_pinctrl_release_state(struct intel_pinctrl *pctl) {
+    if (pctl->tx_shadow) {
+        IOFree(pctl->tx_shadow, pctl->npin_map * sizeof(uint32_t));
+        pctl->tx_shadow = NULL;
+    }
+
+    intel_pinctrl_release_pin_maps(pctl);
+
+    for (size_t i = 0; i < pctl->ncommunities; i++) {
+        struct intel_community *community = &pctl->communities[i];
+
+        if (community->gpps_alloc) {
+            IOFree((void *)community->gpps, community->ngpps * sizeof(struct intel_padgroup));
+            community->gpps = NULL;
+        }
+        community->irqs = NULL;
+
+        if (community->gpp_state) {
+            IOFree(community->gpp_state, sizeof(struct intel_padgroup_state) * community->ngpps);
+            community->gpp_state = NULL;
+        }
+    }
+
+    if (pctl->pin_irqs) {
+        IOFreeAligned(pctl->pin_irqs, pctl->npin_irqs * sizeof(struct intel_pin_irq));
+        pctl->pin_irqs = NULL;
+    }
+
+#ifdef VOODOOGPIO_LATENCY_STATS
+    if (pctl->pin_latency) {
+        IOFree(pctl->pin_latency, pctl->npin_irqs * sizeof(struct intel_pin_latency));
+        pctl->pin_latency = NULL;
+    }
+#endif
+}
+
+/**
+ * Read the PAD_OWN registers of a pad group, the per pad group counterpart
+ * of intel_pad_owned_by_host().
+ *
+ * @return Pins of the pad group that the host owns.
+ */
+uint32_t intel_pinctrl_owned_padgroup(const struct intel_pinctrl *pctl, const struct intel_community *community,
+                                      unsigned gpp) {
+    const struct intel_padgroup *padgrp = &community->gpps[gpp];
+    uint32_t owned = 0;
+
+    if (!community->padown_offset)
+        return 0xffffffff;
+
+    uintptr_t padown = community->regs + community->padown_offset + padgrp->padown_num * 4;
+
+    for (unsigned reg = 0; reg < DIV_ROUND_UP(padgrp->size, 8); reg++) {
+        uint32_t val = readl(padown + reg * 4);
+
+        for (unsigned k = 0; k < 8; k++) {
+            if (!(val & PADOWN_MASK(k)))
+                owned |= BIT(reg * 8 + k);
+        }
+    }
+
+    return owned;
+}
+
+/**
+ * Read PAD_OWN, PADCFGLOCK and PADCFGLOCKTX of a pad group in one pass.
+ * This replaces the per-pin lookups of intel_pad_owned_by_host() and
+ * intel_pad_locked(), which cost three uncached reads for every pin.
+ *
+ * @param community Community the pad group belongs to.
+ * @param gpp Index of the pad group in @community->gpps.
+ * @return Pins of the pad group that the host owns and that are unlocked.
+ */
+uint32_t intel_pinctrl_snapshot_padgroup(const struct intel_pinctrl *pctl, const struct intel_community *community,
+                                         unsigned gpp) {
+    const struct intel_padgroup *padgrp = &community->gpps[gpp];
+    uint32_t owned = intel_pinctrl_owned_padgroup(pctl, community, gpp), locked = 0;
+
+    /*
+     * If PADCFGLOCK and PADCFGLOCKTX bits are both clear for a pad, the
+     * pad is considered unlocked. Any other case means that it is either
+     * fully or partially locked and we don't touch it.
+     */
+    if (community->padcfglock_offset) {
+        uintptr_t padcfglock = community->regs + community->padcfglock_offset + padgrp->reg_num * 8;
+
+        locked = readl(padcfglock) | readl(padcfglock + 4);
+    }
+
+    return owned & ~locked;
+}
+
+/**
+ * Allocate the suspend/resume context. On failure, whatever was allocated
+ * is left for intel_pinctrl_pm_release().
+ */
+bool intel_pinctrl_pm_init(struct intel_pinctrl *pctl) {
+    struct intel_pinctrl_context *context = &pctl->context;
+
+    context->pads = (struct intel_pad_context *)IOMalloc(pctl->npin_map * sizeof(struct intel_pad_context));
+    if (!context->pads)
+        return false;
+    memset(context->pads, 0, pctl->npin_map * sizeof(struct intel_pad_context));
+
+    context->communities = (struct intel_community_context *)IOMalloc(pctl->ncommunities *
+                                                                      sizeof(struct intel_community_context));
+    if (!context->communities)
+        return false;
+    memset(context->communities, 0, pctl->ncommunities * sizeof(struct intel_community_context));
+
+    for (size_t i = 0; i < pctl->ncommunities; i++) {
+        struct intel_community *community = &pctl->communities[i];
+        uint32_t *intmask = (uint32_t *)IOMalloc(community->ngpps * sizeof(uint32_t));
+        uint32_t *saved = (uint32_t *)IOMalloc(community->ngpps * sizeof(uint32_t));
+
+        context->communities[i].intmask = intmask;
+        context->communities[i].saved = saved;
+        if (!intmask || !saved)
+            return false;
+        memset(intmask, 0, community->ngpps * sizeof(uint32_t));
+        memset(saved, 0, community->ngpps * sizeof(uint32_t));
+    }
+    return true;
+}
+
+void intel_pinctrl_pm_release(struct intel_pinctrl *pctl) {
+    struct intel_pinctrl_context *context = &pctl->context;
+
+    if (context->communities) {
+        for (size_t i = 0; i < pctl->ncommunities; i++) {
+            struct intel_community *community = &pctl->communities[i];
+
+            if (context->communities[i].intmask)
+                IOFree(context->communities[i].intmask, community->ngpps * sizeof(uint32_t));
+            if (context->communities[i].saved)
+                IOFree(context->communities[i].saved, community->ngpps * sizeof(uint32_t));
+
+            context->communities[i].intmask = NULL;
+            context->communities[i].saved = NULL;
+        }
+
+        IOFree(context->communities, pctl->ncommunities * sizeof(struct intel_community_context));
+        context->communities = NULL;
+    }
+
+    if (context->pads) {
+        IOFree(context->pads, pctl->npin_map * sizeof(struct intel_pad_context));
+        context->pads = NULL;
+    }
+}
+
+/**
+ * Save the pad configuration of the pins in use, then mask every
+ * registered pin of a pad group with a single write.
+ */
+void intel_pinctrl_suspend(struct intel_pinctrl *pctl) {
+    struct intel_community_context *communityContexts = pctl->context.communities;
+    struct intel_pad_context *pads = pctl->context.pads;
+
+    for (size_t i = 0; i < pctl->ncommunities; i++) {
+        struct intel_community *community = &pctl->communities[i];
+
+        for (unsigned gpp = 0; gpp < community->ngpps; gpp++) {
+            const struct intel_padgroup *padgrp = &community->gpps[gpp];
+            struct intel_padgroup_state *state = &community->gpp_state[gpp];
+
+            /* Pads may be reset or restored across sleep, read them again */
+            state->tx_shadowed = 0;
+
+            /*
+             * Pins still waiting for a deferred re-arm have the pads the
+             * firmware left and are not in @ie yet. What was saved for them
+             * at the previous sleep is still what they should get back.
+             */
+            uint32_t pending = state->rearm;
+            uint32_t kept = communityContexts[i].saved[gpp] & pending;
+
+            /* Throttled pins are logically enabled; wake unmasks them */
+            communityContexts[i].intmask[gpp] = ((state->ie | state->throttled) & ~pending) |
+                                                (communityContexts[i].intmask[gpp] & pending);
+            communityContexts[i].saved[gpp] = kept;
+
+            /*
+             * Only save pins that are actually in use by the kernel (or
+             * by userspace). It is possible that some pins are used by
+             * the BIOS during resume and those are not always locked down
+             * so leave them alone.
+             */
+            uint32_t in_use = (state->registered | state->configured) & ~pending;
+            if (!in_use)
+                continue;
+
+            communityContexts[i].saved[gpp] |= in_use & intel_pinctrl_snapshot_padgroup(pctl, community, gpp);
+
+            for (uint32_t bits = communityContexts[i].saved[gpp] & ~kept; bits; bits &= bits - 1) {
+                unsigned pin = padgrp->base + __builtin_ctz(bits);
+                uintptr_t padcfg;
+
+                if (pin >= pctl->npin_map)
+                    break;
+
+                pads[pin].padcfg0 = readl(intel_get_padcfg(pctl, pin, PADCFG0)) & ~PADCFG0_GPIORXSTATE;
+                pads[pin].padcfg1 = readl(intel_get_padcfg(pctl, pin, PADCFG1));
+
+                padcfg = intel_get_padcfg(pctl, pin, PADCFG2);
+                if (padcfg)
+                    pads[pin].padcfg2 = readl(padcfg);
+            }
+        }
+    }
+
+    for (size_t i = 0; i < pctl->ncommunities; i++) {
+        struct intel_community *community = &pctl->communities[i];
+
+        for (unsigned gpp = 0; gpp < community->ngpps; gpp++) {
+            struct intel_padgroup_state *state = &community->gpp_state[gpp];
+
+            state->throttled &= ~state->registered;
+            intel_gpio_write_ie(pctl, community, gpp, state->ie & ~state->registered);
+        }
+    }
+}
+
+/**
+ * Restore the saved pad configuration of @pins and unmask those of them
+ * that were enabled before sleep, writing only registers the firmware
+ * changed while we were asleep.
+ *
+ * @param community Community the pad group belongs to.
+ * @param gpp Index of the pad group in @community->gpps.
+ * @param pins Pins of the pad group to re-arm.
+ * @return Number of pad registers that had to be rewritten.
+ */
+unsigned intel_pinctrl_rearm_padgroup(struct intel_pinctrl *pctl, struct intel_community *community, unsigned gpp,
+                                      uint32_t pins) {
+    const struct intel_padgroup *padgrp = &community->gpps[gpp];
+    struct intel_padgroup_state *state = &community->gpp_state[gpp];
+    struct intel_pad_context *pads = pctl->context.pads;
+    struct intel_community_context *communityContext = &pctl->context.communities[community - pctl->communities];
+    uint32_t restore = pins & communityContext->saved[gpp];
+    unsigned clobbered = 0;
+
+    if (!pins)
+        return 0;
+    state->rearm &= ~pins;
+
+    /* Firmware may have changed ownership or locks while we were asleep */
+    if (restore)
+        restore &= intel_pinctrl_snapshot_padgroup(pctl, community, gpp);
+
+    for (uint32_t bits = restore; bits; bits &= bits - 1) {
+        unsigned pin = padgrp->base + __builtin_ctz(bits);
+        uintptr_t padcfg;
+        uint32_t val;
+
+        if (pin >= pctl->npin_map)
+            break;
+
+        padcfg = intel_get_padcfg(pctl, pin, PADCFG0);
+        val = readl(padcfg) & ~PADCFG0_GPIORXSTATE;
+        if (val != pads[pin].padcfg0) {
+            writel(pads[pin].padcfg0, padcfg);
+            clobbered++;
+        }
+
+        padcfg = intel_get_padcfg(pctl, pin, PADCFG1);
+        val = readl(padcfg);
+        if (val != pads[pin].padcfg1) {
+            writel(pads[pin].padcfg1, padcfg);
+            clobbered++;
+        }
+
+        padcfg = intel_get_padcfg(pctl, pin, PADCFG2);
+        if (padcfg) {
+            val = readl(padcfg);
+            if (val != pads[pin].padcfg2) {
+                writel(pads[pin].padcfg2, padcfg);
+                clobbered++;
+            }
+        }
+    }
+
+    uint32_t unmask = communityContext->intmask[gpp] & pins & ~state->ie;
+
+    /* Clear interrupt status first to avoid unexpected interrupt */
+    if (unmask) {
+        writel(unmask, community->regs + GPI_IS + padgrp->reg_num * 4);
+        intel_gpio_write_ie(pctl, community, gpp, state->ie | unmask);
+    }
+
+    return clobbered;
+}
+
+/**
+ * Bring the controller back to its state before intel_pinctrl_suspend().
+ * GPI_IE is first put back to what we left at sleep, which has every
+ * registered pin masked, so nothing fires while the pads are restored.
+ * Counts the wake and the registers rewritten in @stats.
+ *
+ * @param defer Only mark registered pins for re-arm instead of restoring
+ *              them; see intel_gpio_rearm_pin() and
+ *              intel_pinctrl_rearm_pending().
+ * @return Number of registers that had to be rewritten.
+ */
+unsigned intel_pinctrl_resume(struct intel_pinctrl *pctl, bool defer) {
+    unsigned clobbered = 0;
+
+    for (size_t i = 0; i < pctl->ncommunities; i++) {
+        struct intel_community *community = &pctl->communities[i];
+        uintptr_t base = community->regs + community->ie_offset;
+
+        for (unsigned gpp = 0; gpp < community->ngpps; gpp++) {
+            struct intel_padgroup_state *state = &community->gpp_state[gpp];
+            uintptr_t reg = base + community->gpps[gpp].reg_num * 4;
+
+            if (readl(reg) != state->ie) {
+                writel(state->ie, reg);
+                clobbered++;
+            }
+
+            if (defer)
+                state->rearm = state->registered | state->configured;
+            else
+                clobbered += intel_pinctrl_rearm_padgroup(pctl, community, gpp,
+                                                          state->registered | state->configured);
+        }
+    }
+
+    pctl->stats.wakes++;
+    pctl->stats.wake_clobbered += clobbered;
+    pctl->stats.last_wake_clobbered = clobbered;
+    return clobbered;
+}
+
+/**
+ * Re-arm a pin still waiting for it after wake, so that a client call on
+ * it is not undone by the deferred restore.
+ *
+ * @param pin Hardware GPIO pin number.
+ * @param unmask Whether to unmask the pin if it was enabled before sleep.
+ *               Callers about to mask it restore only the pad.
+ */
+void intel_gpio_rearm_pin(struct intel_pinctrl *pctl, unsigned pin, bool unmask) {
+    const struct intel_pad_desc *desc = &pctl->pad_descs[pin];
+
+    if (!(desc->flags & INTEL_PAD_HAS_PADGROUP))
+        return;
+
+    struct intel_community *community = &pctl->communities[pctl->pin_map[pin].community];
+    unsigned gpp = pctl->pin_map[pin].padgroup;
+
+    if (community->gpp_state[gpp].rearm & desc->mask) {
+        if (!unmask)
+            pctl->context.communities[community - pctl->communities].intmask[gpp] &= ~desc->mask;
+
+        unsigned clobbered = intel_pinctrl_rearm_padgroup(pctl, community, gpp, desc->mask);
+        pctl->stats.wake_clobbered += clobbered;
+        pctl->stats.last_wake_clobbered += clobbered;
+    }
+}
+
+/**
+ * Re-arm every pin left pending by a deferred wake.
+ *
+ * @return Number of registers that had to be rewritten.
+ */
+unsigned intel_pinctrl_rearm_pending(struct intel_pinctrl *pctl) {
+    unsigned clobbered = 0;
+
+    for (size_t i = 0; i < pctl->ncommunities; i++) {
+        struct intel_community *community = &pctl->communities[i];
+
+        for (unsigned gpp = 0; gpp < community->ngpps; gpp++)
+            clobbered += intel_pinctrl_rearm_padgroup(pctl, community, gpp, community->gpp_state[gpp].rearm);
+    }
+
+    pctl->stats.wake_clobbered += clobbered;
+    pctl->stats.last_wake_clobbered += clobbered;
+    return clobbered;
+}
+
+#ifdef VOODOOGPIO_LATENCY_STATS
+/**
+ * Add the interval between two mach_absolute_time() stamps to a log2
+ * histogram: bucket n counts intervals of [2^(n-1), 2^n) nanoseconds.
+ */
+void intel_latency_record(uint32_t *histogram, uint64_t start, uint64_t end) {
+    uint64_t ns;
+    unsigned bucket;
+
+    absolutetime_to_nanoseconds(end - start, &ns);
+    bucket = ns ? 64 - __builtin_clzll(ns) : 0;
+    if (bucket >= kLatencyBuckets)
+        bucket = kLatencyBuckets - 1;
+    histogram[bucket]++;
+}
+#endif
+
+/**
+ * Read the input level of a fired pin as part of its dispatch.
+ *
+ * @param pin Pin number relative to @community.
+ * @return 1 if PADCFG0_GPIORXSTATE is set, 0 otherwise.
+ */
+static uint32_t intel_gpio_read_rxstate(struct intel_pinctrl *pctl, struct intel_community *community, unsigned pin) {
+    uint32_t padcfg0 = readl(community->regs + pctl->pad_descs[community->pin_base + pin].padcfg + PADCFG0);
+    OSAddAtomic64(1, (volatile int64_t *)&pctl->stats.mmio_reads);
+    return !!(padcfg0 & PADCFG0_GPIORXSTATE);
+}
+
+/**
+ * Primary interrupt context. Append an edge to the ring of a pin in
+ * capture mode. This is the only producer of the ring.
+ *
+ * @param ring Ring as loaded once by the dispatcher.
+ * @param pin Pin number relative to @community.
+ */
+static void intel_gpio_capture_edge(struct intel_pinctrl *pctl, struct intel_community *community,
+                                    struct intel_edge_ring *ring, unsigned pin, uint64_t now) {
+    uint32_t head = ring->head;
+
+    if (head - ring->tail > ring->mask) {
+        OSAddAtomic64(1, (volatile int64_t *)&ring->overflows);
+        return;
+    }
+
+    struct intel_edge_event *event = &ring->events[head & ring->mask];
+    event->time = now;
+    event->rxstate = intel_gpio_read_rxstate(pctl, community, pin);
+
+    /* Publish the entry only once it is complete */
+    OSMemoryBarrier();
+    ring->head = head + 1;
+}
+
+/**
+ * Call the handlers of the groups that fired during the scan, once each,
+ * then acknowledge the level pins among them.
+ *
+ * @return Number of MMIO writes issued.
+ */
+static unsigned intel_gpio_flush_groups(struct intel_pinctrl *pctl) {
+    unsigned writes = 0;
+
+    while (pctl->pending_groups) {
+        struct intel_pin_group *group = pctl->pending_groups;
+        pctl->pending_groups = group->next_pending;
+        group->pending = false;
+
+        /* The handler may unregister the group, do not touch it afterwards */
+        group->handler(group->owner, group->refcon, pctl->nub, group->fired, group->rxstate, group->npins);
+    }
+
+    if (!pctl->group_acks)
+        return 0;
+    pctl->group_acks = false;
+
+    for (size_t i = 0; i < pctl->ncommunities; i++) {
+        struct intel_community *community = &pctl->communities[i];
+
+        for (unsigned gpp = 0; gpp < community->ngpps; gpp++) {
+            struct intel_padgroup_state *state = &community->gpp_state[gpp];
+            if (!state->ack)
+                continue;
+
+            writel(state->ack, community->regs + GPI_IS + community->gpps[gpp].reg_num * 4);
+            writes++;
+            state->ack = 0;
+        }
+    }
+
+    return writes;
+}
+
+/**
+ * Acknowledge and dispatch the fired pins of a pad group. Edge pins are
+ * cleared with a single GPI_IS write before their handlers run, so an edge
+ * arriving meanwhile is not lost. Level pins are cleared with a single write
+ * afterwards, once the client has had a chance to quiesce the source.
+ *
+ * @param community Community the pad group belongs to.
+ * @param gpp Index of the pad group in @community->gpps.
+ * @param fired Pending, enabled and registered pins of the pad group.
+ * @return Number of MMIO writes issued.
+ */
+static unsigned intel_gpio_dispatch_padgroup(struct intel_pinctrl *pctl, struct intel_community *community,
+                                             unsigned gpp, uint32_t fired) {
+    const struct intel_padgroup *padgrp = &community->gpps[gpp];
+    struct intel_padgroup_state *state = &community->gpp_state[gpp];
+    uintptr_t is_reg = community->regs + GPI_IS + padgrp->reg_num * 4;
+    uint32_t edge = fired & ~state->level;
+    uint32_t level = fired & state->level;
+    unsigned padno = padgrp->base - community->pin_base;
+    unsigned writes = 0;
+
+    if (edge) {
+        writel(edge, is_reg);
+        writes++;
+    }
+
+    /* Walk the set bits only, lowest first */
+    while (fired) {
+        unsigned pin = padno + __builtin_ctz(fired);
+        fired &= fired - 1;
+
+        struct intel_pin_irq *irq = &community->irqs[pin];
+        VoodooGPIOAction handler = irq->handler;
+        struct intel_edge_ring *capture = irq->capture;
+        uint8_t mode = irq->mode;
+        if (!irq->owner)
+            continue;
+
+        uint64_t now = mach_absolute_time();
+
+        /* Clients may read and reset the count of a counting pin at any time */
+        if (mode == INTEL_PIN_IRQ_COUNTING)
+            OSAddAtomic64(1, (volatile int64_t *)&irq->count);
+        else
+            irq->count++;
+        irq->last_fired = now;
+        if (mode == INTEL_PIN_IRQ_GROUP) {
+            struct intel_pin_group *group = irq->group;
+            uint32_t word = irq->group_index / 32;
+            uint32_t bit = 1U << (irq->group_index % 32);
+            uint32_t mask = (uint32_t)BIT(pin - padno);
+
+            if (!group->pending) {
+                memset(group->fired, 0, DIV_ROUND_UP(group->npins, 32) * sizeof(uint32_t));
+                group->pending = true;
+                group->next_pending = pctl->pending_groups;
+                pctl->pending_groups = group;
+            }
+            group->fired[word] |= bit;
+            if (intel_gpio_read_rxstate(pctl, community, pin))
+                group->rxstate[word] |= bit;
+            else
+                group->rxstate[word] &= ~bit;
+
+            if (level & mask) {
+                level &= ~mask;
+                state->ack |= mask;
+                pctl->group_acks = true;
+            }
+        } else if (mode == INTEL_PIN_IRQ_CAPTURE) {
+            intel_gpio_capture_edge(pctl, community, capture, pin, now);
+        } else if (mode != INTEL_PIN_IRQ_COUNTING) {
+#ifdef VOODOOGPIO_LATENCY_STATS
+            struct intel_pin_latency *latency = &pctl->pin_latency[irq - pctl->pin_irqs];
+            intel_latency_record(latency->dispatch, pctl->irq_entry_time, now);
+#endif
+            if (mode == INTEL_PIN_IRQ_EXTENDED)
+                irq->extended(irq->owner, irq->refcon, pctl->nub, pin,
+                              intel_gpio_read_rxstate(pctl, community, pin), now);
+            else if (handler)
+                handler(irq->owner, irq->refcon, pctl->nub, pin);
+#ifdef VOODOOGPIO_LATENCY_STATS
+            intel_latency_record(latency->handler, now, mach_absolute_time());
+#endif
+        }
+
+        if (now - irq->window_start > pctl->storm_window) {
+            irq->window_start = now;
+            irq->window_count = 0;
+        }
+        /* An edge of a counting pin costs no handler, so it gets a higher limit */
+        uint32_t threshold = mode == INTEL_PIN_IRQ_COUNTING ? pctl->counter_storm_threshold : pctl->storm_threshold;
+        if (++irq->window_count > threshold) {
+            /* Masking is left to the work loop, which owns GPI_IE */
+            OSBitOrAtomic((uint32_t)BIT(pin - padno), &state->storming);
+            pctl->storm_pending = true;
+        }
+    }
+
+    if (level) {
+        writel(level, is_reg);
+        writes++;
+    }
+
+    return writes;
+}
+
+/**
+ * @param reads Incremented by the number of MMIO reads issued.
+ * @return Number of MMIO writes issued.
+ */
+static unsigned intel_gpio_community_irq_handler(struct intel_pinctrl *pctl, struct intel_community *community,
+                                                 unsigned *reads) {
+    uint32_t active = community->active_gpps;
+    unsigned writes = 0;
+
+    /* Only pad groups with registered, enabled pins are read */
+    while (active) {
+        unsigned gpp = __builtin_ctz(active);
+        active &= active - 1;
+
+        const struct intel_padgroup *padgrp = &community->gpps[gpp];
+        const struct intel_padgroup_state *state = &community->gpp_state[gpp];
+
+        uint32_t pending;
+
+        pending = readl(community->regs + GPI_IS + padgrp->reg_num * 4);
+        (*reads)++;
+
+        /* Only interrupts that are enabled and have a client */
+        pending = intel_padgroup_pending_gated(state, pending);
+        if (!pending)
+            continue;
+
+        writes += intel_gpio_dispatch_padgroup(pctl, community, gpp, pending);
+    }
+
+    return writes;
+}
+
+/**
+ * Primary interrupt context. Dispatches the filter pins and leaves
+ * everything else to intel_gpio_irq_handler().
+ *
+ * @return true if other pins are pending and intel_gpio_irq_handler()
+ *         must run.
+ */
+bool intel_gpio_irq_filter(struct intel_pinctrl *pctl) {
+#ifdef VOODOOGPIO_LATENCY_STATS
+    pctl->irq_entry_time = mach_absolute_time();
+#endif
+    pctl->stats.interrupts++;
+
+    if (!pctl->nfilter_pins)
+        return true;
+
+    bool deferred = false;
+    unsigned reads = 0, writes = 0;
+
+    for (uint32_t active_comm = pctl->active_communities; active_comm; active_comm &= active_comm - 1) {
+        struct intel_community *community = &pctl->communities[__builtin_ctz(active_comm)];
+
+        for (uint32_t active = community->active_gpps; active; active &= active - 1) {
+            unsigned gpp = __builtin_ctz(active);
+            const struct intel_padgroup *padgrp = &community->gpps[gpp];
+            const struct intel_padgroup_state *state = &community->gpp_state[gpp];
+            uint32_t pending, fast;
+
+            pending = readl(community->regs + GPI_IS + padgrp->reg_num * 4);
+            pending = intel_padgroup_pending(state, pending);
+            reads++;
+
+            fast = pending & state->filter;
+            if (pending & ~fast)
+                deferred = true;
+            if (fast)
+                writes += intel_gpio_dispatch_padgroup(pctl, community, gpp, fast);
+        }
+    }
+
+    /* Storming pins can only be throttled with the gate held */
+    if (pctl->storm_pending)
+        deferred = true;
+
+    OSAddAtomic64(reads, (volatile int64_t *)&pctl->stats.mmio_reads);
+    OSAddAtomic64(writes, (volatile int64_t *)&pctl->stats.mmio_writes);
+    return deferred;
+}
+
+/**
+ * Work loop context. Dispatches the pins left by intel_gpio_irq_filter(),
+ * then the pin groups that fired, and throttles storming pins.
+ *
+ * @return What intel_gpio_storm_rearm() returned, %0 if it did not run.
+ */
+uint64_t intel_gpio_irq_handler(struct intel_pinctrl *pctl) {
+    unsigned reads = 0, writes = 0;
+    uint64_t next = 0;
+
+    for (uint32_t active = pctl->active_communities; active; active &= active - 1) {
+        struct intel_community *community = &pctl->communities[__builtin_ctz(active)];
+        writes += intel_gpio_community_irq_handler(pctl, community, &reads);
+    }
+
+    if (pctl->pending_groups)
+        writes += intel_gpio_flush_groups(pctl);
+
+    if (pctl->storm_pending)
+        next = intel_gpio_storm_rearm(pctl);
+
+    OSAddAtomic64(reads, (volatile int64_t *)&pctl->stats.mmio_reads);
+    OSAddAtomic64(writes, (volatile int64_t *)&pctl->stats.mmio_writes);
+    return next;
+}
+
+/**
+ * Set the interrupt storm limits.
+ *
+ * @param rate Interrupts per second above which a pin is storming.
+ * @param counter_rate The same for counting pins.
+ * @param backoff_ms First throttling period, capped at kStormMaxBackoffMS.
+ */
+void intel_gpio_storm_setup(struct intel_pinctrl *pctl, uint32_t rate, uint32_t counter_rate, uint32_t backoff_ms) {
+    pctl->storm_threshold = max(rate / (1000 / kStormWindowMS), 1U);
+    pctl->counter_storm_threshold = max(counter_rate / (1000 / kStormWindowMS), 1U);
+    pctl->storm_backoff_ms = min(backoff_ms, kStormMaxBackoffMS);
+    nanoseconds_to_absolutetime(kStormWindowMS * kMillisecondScale, &pctl->storm_window);
+}
+
+/**
+ * Mask a pin that fired more than storm_threshold times within one storm
+ * window. The pin stays masked for its backoff period, which doubles for
+ * every storm that follows within kStormForgetMS of the previous one.
+ *
+ * @param pin Pin index inside @community.
+ * @param now Time of the dispatch that crossed the threshold.
+ */
+static void intel_gpio_storm_throttle(struct intel_pinctrl *pctl, struct intel_community *community, unsigned gpp,
+                                      unsigned pin, uint64_t now) {
+    struct intel_pin_irq *irq = &community->irqs[pin];
+    struct intel_padgroup_state *state = &community->gpp_state[gpp];
+    uint32_t mask = pctl->pad_descs[community->pin_base + pin].mask;
+    uint64_t forget;
+
+    nanoseconds_to_absolutetime(kStormForgetMS * kMillisecondScale, &forget);
+    if (irq->backoff_ms && now - irq->last_storm < forget)
+        irq->backoff_ms = min(irq->backoff_ms * 2, kStormMaxBackoffMS);
+    else
+        irq->backoff_ms = pctl->storm_backoff_ms;
+    irq->last_storm = now;
+
+    state->throttled |= mask;
+    pctl->stats.storm_events++;
+
+    intel_gpio_write_ie(pctl, community, gpp, state->ie & ~mask);
+}
+
+/**
+ * Throttle the pins the dispatcher marked as storming and unmask throttled
+ * pins whose backoff has expired. Runs with the gate held.
+ *
+ * @return mach_absolute_time() at which the next throttled pin is due to
+ *         be unmasked, %0 if there is none.
+ */
+uint64_t intel_gpio_storm_rearm(struct intel_pinctrl *pctl) {
+    uint64_t now;
+    uint64_t next = 0;
+
+    /* Cleared first, so a pin marked from now on sets it again */
+    pctl->storm_pending = false;
+
+    for (size_t i = 0; i < pctl->ncommunities; i++) {
+        struct intel_community *community = &pctl->communities[i];
+
+        for (unsigned gpp = 0; gpp < community->ngpps; gpp++) {
+            struct intel_padgroup_state *state = &community->gpp_state[gpp];
+            const struct intel_padgroup *padgrp = &community->gpps[gpp];
+            uint32_t storming = state->storming;
+
+            if (!storming)
+                continue;
+            OSBitAndAtomic(~storming, &state->storming);
+
+            for (storming &= state->registered; storming; storming &= storming - 1) {
+                unsigned pin = padgrp->base - community->pin_base + __builtin_ctz(storming);
+                intel_gpio_storm_throttle(pctl, community, gpp, pin, community->irqs[pin].last_fired);
+            }
+        }
+    }
+
+    now = mach_absolute_time();
+
+    for (size_t i = 0; i < pctl->ncommunities; i++) {
+        struct intel_community *community = &pctl->communities[i];
+
+        for (unsigned gpp = 0; gpp < community->ngpps; gpp++) {
+            struct intel_padgroup_state *state = &community->gpp_state[gpp];
+            const struct intel_padgroup *padgrp = &community->gpps[gpp];
+
+            for (uint32_t throttled = state->throttled; throttled; throttled &= throttled - 1) {
+                unsigned bit = __builtin_ctz(throttled);
+                struct intel_pin_irq *irq = &community->irqs[padgrp->base - community->pin_base + bit];
+                uint64_t backoff, deadline;
+
+                nanoseconds_to_absolutetime((uint64_t)irq->backoff_ms * kMillisecondScale, &backoff);
+                deadline = irq->last_storm + backoff;
+                if (deadline > now) {
+                    if (!next || deadline < next)
+                        next = deadline;
+                    continue;
+                }
+
+                state->throttled &= ~BIT(bit);
+                irq->window_start = now;
+                irq->window_count = 0;
+
+                writel(BIT(bit), community->regs + GPI_IS + padgrp->reg_num * 4);
+                intel_gpio_write_ie(pctl, community, gpp, state->ie | BIT(bit));
+            }
+        }
+    }
+
+    return next;
+}
+
+/**
+ * Claim a pin for @owner. The descriptor is filled in completely before
+ * the pin gets its owner, so the filter never dispatches it half set up.
+ *
+ * @param pin Hardware GPIO pin number.
+ * @param desc Delivery of the pin: @mode, the matching handler, ring or
+ *             group, @refcon and @group_index. Other fields are ignored.
+ * @param filter Whether the pin may be dispatched from primary interrupt context.
+ * @return false if the pin already has an owner.
+ */
+bool intel_gpio_claim_irq(struct intel_pinctrl *pctl, unsigned pin, OSObject *owner,
+                          const struct intel_pin_irq *desc, bool filter) {
+    const struct intel_pin_map *map = &pctl->pin_map[pin];
+    struct intel_community *community = &pctl->communities[map->community];
+    struct intel_pin_irq *irq = &community->irqs[pin - community->pin_base];
+
+    if (irq->owner)
+        return false;
+
+    irq->handler = desc->handler;
+    switch (desc->mode) {
+        case INTEL_PIN_IRQ_EXTENDED:
+            irq->extended = desc->extended;
+            break;
+        case INTEL_PIN_IRQ_CAPTURE:
+            irq->capture = desc->capture;
+            break;
+        case INTEL_PIN_IRQ_GROUP:
+            irq->group = desc->group;
+            break;
+    }
+    irq->refcon = desc->refcon;
+    irq->count = 0;
+    irq->last_fired = 0;
+    irq->window_start = 0;
+    irq->window_count = 0;
+    irq->group_index = desc->group_index;
+    irq->mode = desc->mode;
+
+    /* The filter only looks at pins with an owner */
+    OSMemoryBarrier();
+    irq->owner = owner;
+
+    if (pctl->pad_descs[pin].flags & INTEL_PAD_HAS_PADGROUP) {
+        unsigned gpp = map->padgroup;
+
+        community->gpp_state[gpp].registered |= pctl->pad_descs[pin].mask;
+        if (filter) {
+            community->gpp_state[gpp].filter |= pctl->pad_descs[pin].mask;
+            OSIncrementAtomic(&pctl->nfilter_pins);
+        }
+        intel_gpio_update_active(pctl, community, gpp);
+    }
+    return true;
+}
+
+/**
+ * Mask a pin and drop its client. The edge ring of a pin in capture mode
+ * is detached but not freed: the filter may still be recording into it
+ * and clients may still be draining it.
+ *
+ * @param pin Hardware GPIO pin number.
+ * @return The detached edge ring, %NULL if the pin was not in capture mode.
+ */
+struct intel_edge_ring *intel_gpio_release_irq(struct intel_pinctrl *pctl, unsigned pin) {
+    const struct intel_pin_map *map = &pctl->pin_map[pin];
+    const struct intel_pad_desc *desc = &pctl->pad_descs[pin];
+    struct intel_community *community = &pctl->communities[map->community];
+    struct intel_pin_irq *irq = &community->irqs[pin - community->pin_base];
+    struct intel_edge_ring *ring = NULL;
+
+    intel_gpio_rearm_pin(pctl, pin, false);
+
+    intel_gpio_irq_mask_unmask(pctl, pin, true);
+
+    if (desc->flags & INTEL_PAD_HAS_PADGROUP) {
+        struct intel_padgroup_state *state = &community->gpp_state[map->padgroup];
+
+        state->registered &= ~desc->mask;
+        state->level &= ~desc->mask;
+        OSBitAndAtomic(~desc->mask, &state->storming);
+        if (state->filter & desc->mask) {
+            state->filter &= ~desc->mask;
+            OSDecrementAtomic(&pctl->nfilter_pins);
+        }
+        intel_gpio_update_active(pctl, community, map->padgroup);
+    }
+
+    /* The dispatcher loads the union before the owner, clear the owner first */
+    irq->owner = NULL;
+    OSMemoryBarrier();
+    irq->handler = NULL;
+    irq->type = 0;
+    irq->refcon = NULL;
+    irq->group_index = 0;
+    if (irq->mode == INTEL_PIN_IRQ_CAPTURE)
+        ring = irq->capture;
+    irq->extended = NULL;
+    irq->mode = INTEL_PIN_IRQ_HANDLER;
+
+    OSMemoryBarrier();
+    return ring;
+}
+
+/**
+ * Remember the trigger type of a pin for intel_gpio_irq_set_type() and
+ * whether the dispatcher acknowledges it as a level pin.
+ *
+ * @param pin Hardware GPIO pin number.
+ * @param type IRQ_TYPE_* trigger type.
+ */
+void intel_gpio_store_irq_type(struct intel_pinctrl *pctl, unsigned pin, unsigned type) {
+    const struct intel_pin_map *map = &pctl->pin_map[pin];
+    const struct intel_pad_desc *desc = &pctl->pad_descs[pin];
+    struct intel_community *community = &pctl->communities[map->community];
+
+    community->irqs[pin - community->pin_base].type = type;
+
+    if (desc->flags & INTEL_PAD_HAS_PADGROUP) {
+        struct intel_padgroup_state *state = &community->gpp_state[map->padgroup];
+        if (type & IRQ_TYPE_LEVEL_MASK)
+            state->level |= desc->mask;
+        else
+            state->level &= ~desc->mask;
+    }
+}
+
+/**
+ * @return true if no pin has a client.
+ */
+bool intel_pinctrl_idle(const struct intel_pinctrl *pctl) {
+    for (size_t i = 0; i < pctl->ncommunities; i++) {
+        const struct intel_community *community = &pctl->communities[i];
+
+        for (unsigned gpp = 0; community->gpp_state && gpp < community->ngpps; gpp++) {
+            if (community->gpp_state[gpp].registered)
+                return false;
+        }
+    }
+    return true;
+}
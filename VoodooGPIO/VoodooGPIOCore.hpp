@@ -0,0 +1,685 @@
+//
+//  VoodooGPIOCore.hpp
+//  VoodooGPIO
+//
+//  Platform tables and the driver logic that only needs register access:
+//  probe, pin lookup tables, interrupt masking and dispatch, storm
+//  throttling and suspend/resume. Kept free of IOKit so it builds and runs
+//  on the host against the simulated PCH; VoodooGPIO adds the IOKit glue.
+//
+
+#ifndef VoodooGPIOCore_h
+#define VoodooGPIOCore_h
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "VoodooGPIORegisters.hpp"
+
+class IOMemoryMap;
+class IOService;
+class OSObject;
+struct intel_pin_irq;
+
+struct pinctrl_pin_desc {
+    unsigned number;
+    char *name;
+    void *drv_data;
+};
+
+#define PINCTRL_PIN(a, b) {.number = a, .name = b}
+#define PINCTRL_PIN_ANON(a) {.number = a}
+
+
+/**
+ * struct intel_pingroup - Description about group of pins
+ * @name: Name of the groups
+ * @pins: All pins in this group
+ * @npins: Number of pins in this groups
+ * @mode: Native mode in which the group is muxed out @pins. Used if @modes
+ *        is %NULL.
+ * @modes: If not %NULL this will hold mode for each pin in @pins
+ */
+struct intel_pingroup {
+    char *name;
+    unsigned *pins;
+    size_t npins;
+    unsigned short mode;
+    unsigned *modes;
+};
+
+/**
+ * struct intel_function - Description about a function
+ * @name: Name of the function
+ * @groups: An array of groups for this function
+ * @ngroups: Number of groups in @groups
+ */
+struct intel_function {
+    char *name;
+    char * const *groups;
+    size_t ngroups;
+};
+
+/**
+ * struct intel_padgroup - Hardware pad group information
+ * @reg_num: GPI_IS register number
+ * @base: Starting pin of this group
+ * @size: Size of this group (maximum is 32).
+ * @gpio_base: Starting GPIO base of this group (%0 if matches with @base,
+ *             and %-1 if no GPIO mapping should be created)
+ * @padown_num: PAD_OWN register number (assigned by the core driver)
+ *
+ * If pad groups of a community are not the same size, use this structure
+ * to specify them.
+ */
+struct intel_padgroup {
+    uint32_t reg_num;
+    uint32_t base;
+    uint32_t size;
+    int32_t gpio_base;
+    uint32_t padown_num;
+};
+
+
+/**
+ * struct intel_padgroup_state - Software state of a pad group
+ * @ie: Copy of GPI_IE. Authoritative for reads; hardware is only written
+ *      when the value changes.
+ * @filter: Pins whose clients are dispatched from primary interrupt context
+ * @registered: Pins that have a client
+ * @level: Registered pins that are level triggered
+ * @throttled: Pins masked because of an interrupt storm
+ * @configured: Pins with debounce or glitch filter settings or driven by the
+ *              GPIO data API, saved across sleep even without a client
+ * @rearm: Pins whose pad configuration and interrupt enable are still to
+ *         be restored after a deferred wake
+ * @ack: Level pins of groups, acknowledged only after the group handlers ran
+ * @tx_shadowed: Pins whose PADCFG0 is cached in tx_shadow. Authoritative
+ *               for output writes until the driver writes PADCFG0 otherwise.
+ * @storming: Pins that crossed the storm threshold and are still to be
+ *            throttled by the work loop. Set atomically by the dispatcher.
+ *
+ * Everything but @storming is only written with the work loop gate held.
+ */
+struct intel_padgroup_state {
+    uint32_t ie;
+    uint32_t filter;
+    uint32_t registered;
+    uint32_t level;
+    uint32_t throttled;
+    uint32_t configured;
+    uint32_t rearm;
+    uint32_t ack;
+    uint32_t tx_shadowed;
+    volatile uint32_t storming;
+};
+
+
+/**
+ * struct intel_community - Intel pin community description
+ * @barno: MMIO BAR number where registers for this community reside
+ * @padown_offset: Register offset of PAD_OWN register from @regs. If %0
+ *                 then there is no support for owner.
+ * @padcfglock_offset: Register offset of PADCFGLOCK from @regs. If %0 then
+ *                     locking is not supported.
+ * @hostown_offset: Register offset of HOSTSW_OWN from @regs. If %0 then it
+ *                  is assumed that the host owns the pin (rather than
+ *                  ACPI).
+ * @ie_offset: Register offset of GPI_IE from @regs.
+ * @pin_base: Starting pin of pins in this community
+ * @gpp_size: Maximum number of pads in each group, such as PADCFGLOCK,
+ *            HOSTSW_OWN,  GPI_IS, GPI_IE, etc. Used when @gpps is %NULL.
+ * @gpp_num_padown_regs: Number of pad registers each pad group consumes at
+ *			 minimum. Use %0 if the number of registers can be
+ *			 determined by the size of the group.
+ * @npins: Number of pins in this community
+ * @features: Additional features supported by the hardware
+ * @gpps: Pad groups if the controller has variable size pad groups
+ * @ngpps: Number of pad groups in this community
+ * @regs: Community specific common registers (reserved for core driver)
+ * @pad_regs: Community specific pad registers (reserved for core driver)
+ * @gpp_state: Software state of each pad group (reserved for core driver)
+ * @active_gpps: Bitmap of pad groups that have registered pins enabled and
+ *               need to be read on interrupt (reserved for core driver)
+ * @irqs: Interrupt state of each pin in the community (reserved for core
+ *        driver). Points into a single controller-wide allocation.
+ *
+ * Most Intel GPIO host controllers this driver supports each pad group is
+ * of equal size (except the last one). In that case the driver can just
+ * fill in @gpp_size field and let the core driver to handle the rest. If
+ * the controller has pad groups of variable size the client driver can
+ * pass custom @gpps and @ngpps instead.
+ */
+struct intel_community {
+    unsigned barno;
+    unsigned padown_offset;
+    unsigned padcfglock_offset;
+    unsigned hostown_offset;
+    unsigned ie_offset;
+    unsigned pin_base;
+    unsigned gpp_size;
+    unsigned gpp_num_padown_regs;
+    size_t npins;
+    unsigned features;
+    const struct intel_padgroup *gpps;
+    size_t ngpps;
+    bool gpps_alloc;
+    /* Reserved for the core driver */
+    IOMemoryMap *mmap;
+    uintptr_t regs;
+    uintptr_t pad_regs;
+    struct intel_padgroup_state *gpp_state;
+    uint32_t active_gpps;
+    struct intel_pin_irq *irqs;
+};
+
+
+/**
+ * struct intel_pin_map - Location of a pin inside the controller
+ * @pin: Hardware pin number
+ * @community: Index into the communities array, %INTEL_PIN_MAP_NONE if the
+ *             entry does not map to a pin
+ * @padgroup: Index into the gpps of @community, %INTEL_PIN_MAP_NONE if the
+ *            pin is not part of any pad group
+ * @offset: Bit offset of the pin inside its pad group
+ *
+ * Built once at start so that hardware pin and GPIO offset lookups are a
+ * single indexed load instead of a walk over communities and pad groups.
+ */
+struct intel_pin_map {
+    uint16_t pin;
+    uint8_t community;
+    uint8_t padgroup;
+    uint8_t offset;
+};
+
+#define INTEL_PIN_MAP_NONE  0xff
+
+/**
+ * struct intel_pad_desc - Precomputed register locations of a pin
+ * @padcfg: Offset of PADCFG0 from the community regs. PADCFG1 and PADCFG2
+ *          follow at +4 and +8.
+ * @mask: Bit of the pin in GPI_IS, GPI_IE, HOSTSW_OWN and PADCFGLOCK
+ * @is_reg: Offset of the pad group GPI_IS register
+ * @ie_reg: Offset of the pad group GPI_IE register
+ * @padown: Offset of the PAD_OWN register, %0 if ownership is not supported
+ * @hostown: Offset of the HOSTSW_OWN register, %0 if not supported
+ * @padcfglock: Offset of PADCFGLOCK, %0 if locking is not supported.
+ *              PADCFGLOCKTX follows at +4.
+ * @padown_shift: Shift of the pin's field inside @padown
+ * @flags: %INTEL_PAD_* flags
+ *
+ * Filled once after the pad groups are known so that pin operations are a
+ * table lookup followed by the MMIO access itself.
+ */
+struct intel_pad_desc {
+    uint32_t padcfg;
+    uint32_t mask;
+    uint16_t is_reg;
+    uint16_t ie_reg;
+    uint16_t padown;
+    uint16_t hostown;
+    uint16_t padcfglock;
+    uint8_t padown_shift;
+    uint8_t flags;
+};
+
+#define INTEL_PAD_HAS_PADCFG2   1
+#define INTEL_PAD_HAS_PADGROUP  2
+
+
+/**
+ * struct intel_pinctrl_soc_data - Intel pin controller per-SoC configuration
+ * @name: Name of the platform
+ * @pins: Array of pins this pinctrl controls
+ * @npins: Number of pins in the array
+ * @groups: Array of pin groups
+ * @ngroups: Number of groups in the array
+ * @functions: Array of functions
+ * @nfunctions: Number of functions in the array
+ * @communities: Array of communities this pinctrl handles
+ * @ncommunities: Number of communities in the array
+ */
+struct intel_pinctrl_soc_data {
+    const char *name;
+    struct pinctrl_pin_desc *pins;
+    size_t npins;
+    const struct intel_pingroup *groups;
+    size_t ngroups;
+    struct intel_function *functions;
+    size_t nfunctions;
+    struct intel_community *communities;
+    size_t ncommunities;
+};
+
+
+/* Additional features supported by the hardware */
+#define PINCTRL_FEATURE_DEBOUNCE    1
+#define PINCTRL_FEATURE_1K_PD       2
+
+#define ARRAY_SIZE(x) (sizeof(x) / sizeof((x)[0]))
+
+/* Select the mode or the per pin modes of PIN_GROUP() by argument type */
+static inline constexpr unsigned short intel_pingroup_mode(int mode) { return (unsigned short)mode; }
+static inline constexpr unsigned short intel_pingroup_mode(unsigned *) { return 0; }
+static inline constexpr unsigned *intel_pingroup_modes(int) { return nullptr; }
+static inline constexpr unsigned *intel_pingroup_modes(unsigned *modes) { return modes; }
+
+/**
+ * PIN_GROUP - Declare a pin group
+ * @n: Name of the group
+ * @p: An array of pins this group consists
+ * @m: Mode which the pins are put when this group is active. Can be either
+ *     a single integer or an array of integers in which case mode is per
+ *     pin.
+ */
+#define PIN_GROUP(n, p, m)                          \
+{                                                   \
+    .name = (n),                                    \
+    .pins = (p),                                    \
+    .npins = ARRAY_SIZE((p)),                       \
+    .mode = intel_pingroup_mode((m)),               \
+    .modes = intel_pingroup_modes((m)),             \
+}
+
+#define FUNCTION(n, g)          \
+{                               \
+    .name = (n),                \
+    .groups = (g),              \
+    .ngroups = ARRAY_SIZE((g)), \
+}
+
+
+size_t intel_community_count_padgroups(const struct intel_community *community);
+bool intel_community_fill_padgroups(const struct intel_community *community, struct intel_padgroup *gpps, size_t ngpps);
+
+void intel_pin_map_sizes(const struct intel_community *communities, size_t ncommunities,
+                         size_t *npin_map, size_t *ngpio_map);
+void intel_pin_map_fill(const struct intel_community *communities, size_t ncommunities,
+                        struct intel_pin_map *pin_map, size_t npin_map,
+                        struct intel_pin_map *gpio_map, size_t ngpio_map);
+void intel_pad_descs_fill(const struct intel_community *communities, const struct intel_pin_map *pin_map,
+                          size_t npin_map, struct intel_pad_desc *pad_descs);
+const struct intel_padgroup *intel_pin_map_padgroup(const struct intel_community *communities,
+                                                    const struct intel_pin_map *pin_map, size_t npin_map,
+                                                    const struct intel_community *community, unsigned pin);
+
+bool intel_debounce_encode(uint32_t debounce, uint32_t *value);
+
+/**
+ * Pins of a pad group to dispatch for a GPI_IS value: pending, enabled and
+ * registered.
+ */
+static inline uint32_t intel_padgroup_pending(const struct intel_padgroup_state *state, uint32_t is) {
+    return is & state->ie & state->registered;
+}
+
+/**
+ * Pins of a pad group for the work loop to dispatch for a GPI_IS value.
+ * Filter pins are left to the filter, even if they latched again after it
+ * ran.
+ */
+static inline uint32_t intel_padgroup_pending_gated(const struct intel_padgroup_state *state, uint32_t is) {
+    return intel_padgroup_pending(state, is) & ~state->filter;
+}
+
+
+/**
+ * Interrupt handler of a pin, the same type as IOInterruptAction.
+ */
+typedef void (*VoodooGPIOAction)(OSObject *target, void *refcon, IOService *nub, int source);
+
+/**
+ * Interrupt handler that also gets the state of the pin at dispatch.
+ *
+ * @param rxstate 1 if PADCFG0_GPIORXSTATE was set when the pin was dispatched.
+ * @param timestamp mach_absolute_time() of the dispatch.
+ */
+typedef void (*VoodooGPIOExtendedAction)(OSObject *owner, void *refcon, IOService *nub, int source,
+                                         uint32_t rxstate, uint64_t timestamp);
+
+/* How a registered pin is delivered, selects the member of the union in intel_pin_irq */
+#define INTEL_PIN_IRQ_HANDLER   0
+#define INTEL_PIN_IRQ_EXTENDED  1
+#define INTEL_PIN_IRQ_COUNTING  2
+#define INTEL_PIN_IRQ_CAPTURE   3
+#define INTEL_PIN_IRQ_GROUP     4
+
+/**
+ * struct intel_pin_irq - Interrupt state of a single pin
+ * @owner: Client that registered the interrupt, %NULL if unregistered
+ * @handler: Client interrupt handler of an INTEL_PIN_IRQ_HANDLER pin
+ * @extended: Client interrupt handler taking the pin state, for
+ *            INTEL_PIN_IRQ_EXTENDED
+ * @capture: Edge ring of an INTEL_PIN_IRQ_CAPTURE pin
+ * @group: Group of an INTEL_PIN_IRQ_GROUP pin
+ * @refcon: Client cookie passed back to @handler or @extended
+ * @count: Number of times the pin has been dispatched. For an
+ *         INTEL_PIN_IRQ_COUNTING pin, the edge count clients read and reset
+ *         with readEdgeCounter()
+ * @last_fired: mach_absolute_time() of the last dispatch
+ * @window_start: Start of the current storm detection window
+ * @window_count: Dispatches since @window_start
+ * @group_index: Bit of the pin in the bitmaps of @group
+ * @mode: INTEL_PIN_IRQ_* delivery mode of the pin
+ * @type: IRQ_TYPE_* trigger type of the pin
+ * @last_storm: mach_absolute_time() of the last storm on this pin
+ * @backoff_ms: Current throttling period, grows with repeated storms
+ * @drainers: drainEdgeCapture() calls in progress on @capture
+ *
+ * Everything the dispatcher touches for a pin lives in the first cache
+ * line, up to @mode. The rest is only used by the work loop and clients.
+ */
+struct intel_pin_irq {
+    OSObject *owner;
+    VoodooGPIOAction handler;
+    union {
+        VoodooGPIOExtendedAction extended;
+        struct intel_edge_ring *capture;
+        struct intel_pin_group *group;
+    };
+    void *refcon;
+    uint64_t count;
+    uint64_t last_fired;
+    uint64_t window_start;
+    uint32_t window_count;
+    uint16_t group_index;
+    uint8_t mode;
+
+    unsigned type;
+    uint64_t last_storm;
+    uint32_t backoff_ms;
+    volatile int32_t drainers;
+} __attribute__((aligned(64)));
+
+static_assert(offsetof(struct intel_pin_irq, mode) + sizeof(uint8_t) <= 64,
+              "intel_pin_irq dispatch fields must fit in the first cache line");
+
+/**
+ * struct intel_edge_event - Edge recorded on a pin in capture mode
+ * @time: mach_absolute_time() at dispatch
+ * @rxstate: Whether PADCFG0_GPIORXSTATE was set at dispatch
+ */
+struct intel_edge_event {
+    uint64_t time;
+    uint32_t rxstate;
+};
+
+/**
+ * struct intel_edge_ring - Single producer, single consumer edge ring
+ * @head: Next slot to fill, only advanced by the dispatcher
+ * @tail: Next slot to drain, only advanced by the client
+ * @overflows: Edges dropped because the ring was full
+ * @mask: Number of entries minus one; the size is a power of two
+ * @events: The entries
+ *
+ * @head and @tail are free-running and wrap at 2^32. The ring holds
+ * @head - @tail events.
+ */
+struct intel_edge_ring {
+    volatile uint32_t head;
+    volatile uint32_t tail;
+    volatile uint64_t overflows;
+    uint32_t mask;
+    struct intel_edge_event events[];
+};
+
+#define kEdgeCaptureMinEntries  16
+#define kEdgeCaptureMaxEntries  65536
+
+/**
+ * Called from the work loop once per controller interrupt for a pin group.
+ *
+ * @param fired Bit i is set if @pins[i] of the registration fired.
+ * @param rxstate Bit i is the PADCFG0_GPIORXSTATE of @pins[i] at dispatch,
+ *                only valid for the pins set in @fired.
+ * @param npins Number of pins of the group; both bitmaps hold
+ *              DIV_ROUND_UP(@npins, 32) words.
+ */
+typedef void (*VoodooGPIOGroupAction)(OSObject *owner, void *refcon, IOService *nub,
+                                      const uint32_t *fired, const uint32_t *rxstate, uint32_t npins);
+
+/**
+ * struct intel_pin_group - Pins claimed together by one client
+ * @owner: Client that registered the group
+ * @handler: Client group handler
+ * @refcon: Client cookie passed back to @handler
+ * @next_pending: Next group fired during the current scan
+ * @pending: Whether the group is on the pending list
+ * @npins: Number of pins in @pins
+ * @fired: Pins fired during the current scan
+ * @rxstate: RXSTATE of the pins in @fired
+ * @pins: 'Software' pin numbers of the group, in registration order
+ */
+struct intel_pin_group {
+    OSObject *owner;
+    VoodooGPIOGroupAction handler;
+    void *refcon;
+    struct intel_pin_group *next_pending;
+    bool pending;
+    uint32_t npins;
+    uint32_t *fired;
+    uint32_t *rxstate;
+    int pins[];
+};
+
+#define kPinGroupMaxPins    256
+
+struct intel_pad_context {
+    uint32_t padcfg0;
+    uint32_t padcfg1;
+    uint32_t padcfg2;
+};
+
+/**
+ * struct intel_community_context - Community state saved across sleep
+ * @intmask: GPI_IE of each pad group
+ * @saved: Pins of each pad group whose pad configuration was saved: the
+ *         registered pins the host owns and that are not locked
+ */
+struct intel_community_context {
+    uint32_t *intmask;
+    uint32_t *saved;
+};
+
+/**
+ * struct intel_pinctrl_context - Controller state saved across sleep
+ * @pads: Pad configuration, indexed by hardware pin number
+ * @communities: Per-community state
+ */
+struct intel_pinctrl_context {
+    struct intel_pad_context *pads;
+    struct intel_community_context *communities;
+};
+
+struct intel_irq_stats {
+    uint64_t interrupts;
+    uint64_t mmio_reads;
+    uint64_t mmio_writes;
+    uint64_t storm_events;
+    uint64_t wakes;
+    uint64_t wake_clobbered;
+    uint32_t last_wake_clobbered;
+    uint64_t idle_entries;
+    uint64_t idle_time;
+};
+
+#ifdef VOODOOGPIO_LATENCY_STATS
+#define kLatencyBuckets 32
+
+/**
+ * struct intel_pin_latency - Latency histograms of a pin (log2 ns buckets)
+ * @dispatch: Controller interrupt entry to client handler call
+ * @handler: Time spent in the client handler
+ */
+struct intel_pin_latency {
+    uint32_t dispatch[kLatencyBuckets];
+    uint32_t handler[kLatencyBuckets];
+};
+#endif
+
+/* Interrupt storm detection */
+#define kStormDefaultRate       10000   /* interrupts per second per pin */
+#define kCounterDefaultRate     1000000 /* edges per second per counting pin */
+#define kStormDefaultBackoffMS  100
+#define kStormMaxBackoffMS      10000U
+#define kStormForgetMS          60000
+#define kStormWindowMS          100
+
+/**
+ * struct intel_pinctrl - Controller state the core logic works on
+ * @backend: Register access backend, %NULL for plain loads and stores
+ * @nub: Passed to the interrupt handlers of clients
+ * @communities: Communities of the controller
+ * @ncommunities: Number of communities
+ * @context: Controller state saved across sleep
+ * @pin_map: Hardware pin lookup table
+ * @npin_map: Number of entries in @pin_map
+ * @gpio_map: GPIO offset lookup table
+ * @ngpio_map: Number of entries in @gpio_map
+ * @pad_descs: Register locations of every hardware pin
+ * @tx_shadow: PADCFG0 of the pins in the @tx_shadowed of their pad group
+ * @pin_irqs: Interrupt state of every pin, shared out to the communities
+ * @npin_irqs: Number of entries in @pin_irqs
+ * @total_gpps: Number of pad groups of all communities
+ * @active_communities: Bitmap of communities with an active pad group
+ * @nfilter_pins: Pins dispatched from primary interrupt context
+ * @pending_groups: Groups that fired during the current scan
+ * @group_acks: Whether level pins of groups wait for their acknowledgement
+ * @storm_window: Storm detection window, in absolute time units
+ * @storm_threshold: Dispatches within a window above which a pin storms
+ * @counter_storm_threshold: The same for counting pins
+ * @storm_backoff_ms: First throttling period of a storming pin
+ * @storm_pending: Pins were marked as storming and wait for the work loop
+ * @stats: Interrupt, storm and wake statistics
+ * @irq_entry_time: mach_absolute_time() of the last controller interrupt
+ * @pin_latency: Latency histograms, indexed like @pin_irqs
+ * @trace: Called for every register access of debug builds
+ * @trace_ctx: Passed back to @trace
+ *
+ * The driver fills in @backend, @nub and the communities and probes them,
+ * everything else belongs to the core. Unless noted otherwise, state is
+ * only changed with the work loop gate held.
+ */
+struct intel_pinctrl {
+    VoodooGPIORegisterBackend *backend;
+    IOService *nub;
+
+    struct intel_community *communities;
+    size_t ncommunities;
+    struct intel_pinctrl_context context;
+
+    struct intel_pin_map *pin_map;
+    size_t npin_map;
+    struct intel_pin_map *gpio_map;
+    size_t ngpio_map;
+    struct intel_pad_desc *pad_descs;
+    uint32_t *tx_shadow;
+
+    struct intel_pin_irq *pin_irqs;
+    size_t npin_irqs;
+    size_t total_gpps;
+    uint32_t active_communities;
+    volatile int32_t nfilter_pins;
+    struct intel_pin_group *pending_groups;
+    bool group_acks;
+
+    uint64_t storm_window;
+    uint32_t storm_threshold;
+    uint32_t counter_storm_threshold;
+    uint32_t storm_backoff_ms;
+    volatile bool storm_pending;
+
+    struct intel_irq_stats stats;
+
+#ifdef VOODOOGPIO_LATENCY_STATS
+    volatile uint64_t irq_entry_time;
+    struct intel_pin_latency *pin_latency;
+#endif
+
+#ifdef VOODOOGPIO_MMIO_TRACE
+    void (*trace)(void *ctx, uintptr_t addr, uint32_t value, bool write, const char *func);
+    void *trace_ctx;
+#endif
+};
+
+/**
+ * Register access of the core. Goes through the backend if one is
+ * installed, and is accounted to @func in debug builds.
+ */
+static inline uint32_t intel_readl(const struct intel_pinctrl *pctl, uintptr_t addr, const char *func) {
+    uint32_t value;
+
+    if (__builtin_expect(pctl->backend != NULL, 0))
+        value = pctl->backend->read32(addr);
+    else
+        value = *(const volatile uint32_t *)addr;
+#ifdef VOODOOGPIO_MMIO_TRACE
+    if (pctl->trace)
+        pctl->trace(pctl->trace_ctx, addr, value, false, func);
+#endif
+    return value;
+}
+
+static inline void intel_writel(const struct intel_pinctrl *pctl, uint32_t value, uintptr_t addr, const char *func) {
+    if (__builtin_expect(pctl->backend != NULL, 0))
+        pctl->backend->write32(value, addr);
+    else
+        *(volatile uint32_t *)addr = value;
+#ifdef VOODOOGPIO_MMIO_TRACE
+    if (pctl->trace)
+        pctl->trace(pctl->trace_ctx, addr, value, true, func);
+#endif
+}
+
+bool intel_pinctrl_probe_community(struct intel_pinctrl *pctl, struct intel_community *community, uintptr_t regs);
+bool intel_pinctrl_alloc_state(struct intel_pinctrl *pctl);
+void intel_pinctrl_release_state(struct intel_pinctrl *pctl);
+bool intel_pinctrl_pm_init(struct intel_pinctrl *pctl);
+void intel_pinctrl_pm_release(struct intel_pinctrl *pctl);
+
+struct intel_community *intel_get_community(const struct intel_pinctrl *pctl, unsigned pin);
+int32_t intel_gpio_to_pin(const struct intel_pinctrl *pctl, uint32_t offset,
+                          const struct intel_community **community, const struct intel_padgroup **padgrp);
+uintptr_t intel_get_padcfg(const struct intel_pinctrl *pctl, unsigned pin, unsigned reg);
+bool intel_pad_owned_by_host(const struct intel_pinctrl *pctl, unsigned pin);
+bool intel_pad_acpi_mode(const struct intel_pinctrl *pctl, unsigned pin);
+bool intel_pad_locked(const struct intel_pinctrl *pctl, unsigned pin);
+uint32_t intel_pinctrl_owned_padgroup(const struct intel_pinctrl *pctl, const struct intel_community *community,
+                                      unsigned gpp);
+uint32_t intel_pinctrl_snapshot_padgroup(const struct intel_pinctrl *pctl, const struct intel_community *community,
+                                         unsigned gpp);
+
+void intel_gpio_irq_enable(struct intel_pinctrl *pctl, unsigned pin);
+void intel_gpio_irq_mask_unmask(struct intel_pinctrl *pctl, unsigned pin, bool mask);
+bool intel_gpio_irq_set_type(struct intel_pinctrl *pctl, unsigned pin, unsigned type);
+void intel_gpio_write_ie(struct intel_pinctrl *pctl, const struct intel_community *community, unsigned gpp,
+                         uint32_t value);
+void intel_gpio_update_active(struct intel_pinctrl *pctl, const struct intel_community *community, unsigned gpp);
+void intel_gpio_sync_ie(struct intel_pinctrl *pctl);
+void intel_gpio_drop_tx_shadow(struct intel_pinctrl *pctl, unsigned pin);
+
+bool intel_gpio_claim_irq(struct intel_pinctrl *pctl, unsigned pin, OSObject *owner,
+                          const struct intel_pin_irq *desc, bool filter);
+struct intel_edge_ring *intel_gpio_release_irq(struct intel_pinctrl *pctl, unsigned pin);
+void intel_gpio_store_irq_type(struct intel_pinctrl *pctl, unsigned pin, unsigned type);
+bool intel_pinctrl_idle(const struct intel_pinctrl *pctl);
+
+bool intel_gpio_irq_filter(struct intel_pinctrl *pctl);
+uint64_t intel_gpio_irq_handler(struct intel_pinctrl *pctl);
+
+void intel_gpio_storm_setup(struct intel_pinctrl *pctl, uint32_t rate, uint32_t counter_rate, uint32_t backoff_ms);
+uint64_t intel_gpio_storm_rearm(struct intel_pinctrl *pctl);
+
+void intel_pinctrl_suspend(struct intel_pinctrl *pctl);
+unsigned intel_pinctrl_resume(struct intel_pinctrl *pctl, bool defer);
+unsigned intel_pinctrl_rearm_padgroup(struct intel_pinctrl *pctl, struct intel_community *community, unsigned gpp,
+                                      uint32_t pins);
+void intel_gpio_rearm_pin(struct intel_pinctrl *pctl, unsigned pin, bool unmask = true);
+unsigned intel_pinctrl_rearm_pending(struct intel_pinctrl *pctl);
+
+#ifdef VOODOOGPIO_LATENCY_STATS
+void intel_latency_record(uint32_t *histogram, uint64_t start, uint64_t end);
+#endif
+
+#endif /* VoodooGPIOCore_h */
@@ -0,0 +1,89 @@
+//
+//  VoodooGPIORegisters.hpp
+//  VoodooGPIO
+//
+//  Register layout of the Intel GPIO communities. Kept free of IOKit so it
+//  can be shared with the simulated PCH.
+//
+
+#ifndef VoodooGPIORegisters_h
+#define VoodooGPIORegisters_h
+
+#include <stdint.h>
+
+#if defined(__LP64__) && __LP64__
+#define BITS_PER_LONG 64
+#else
+#define BITS_PER_LONG 32
+#endif
+
+#define BIT(x) (1UL << (x))
+#define GENMASK(h, l) \
+(((~0UL) << (l)) & (~0UL >> (BITS_PER_LONG - 1 - (h))))
+
+#define DIV_ROUND_UP(n, d) (((n) + (d) - 1) / (d))
+
+/* Offset from regs */
+#define REVID               0x000
+#define REVID_SHIFT         16
+#define REVID_MASK          GENMASK(31, 16)
+
+#define PADBAR              0x00c
+#define GPI_IS              0x100
+
+#define PADOWN_BITS         4
+#define PADOWN_SHIFT(p)     ((p) % 8 * PADOWN_BITS)
+#define PADOWN_MASK(p)      (0xf << PADOWN_SHIFT(p))
+#define PADOWN_GPP(p)       ((p) / 8)
+
+/* Offset from pad_regs */
+#define PADCFG0                     0x000
+#define PADCFG0_RXEVCFG_SHIFT       25
+#define PADCFG0_RXEVCFG_MASK        (3 << PADCFG0_RXEVCFG_SHIFT)
+#define PADCFG0_RXEVCFG_LEVEL       0
+#define PADCFG0_RXEVCFG_EDGE        1
+#define PADCFG0_RXEVCFG_DISABLED    2
+#define PADCFG0_RXEVCFG_EDGE_BOTH   3
+#define PADCFG0_PREGFRXSEL          BIT(24)
+#define PADCFG0_RXINV               BIT(23)
+#define PADCFG0_GPIROUTIOXAPIC      BIT(20)
+#define PADCFG0_GPIROUTSCI          BIT(19)
+#define PADCFG0_GPIROUTSMI          BIT(18)
+#define PADCFG0_GPIROUTNMI          BIT(17)
+#define PADCFG0_PMODE_SHIFT         10
+#define PADCFG0_PMODE_MASK          (0xf << PADCFG0_PMODE_SHIFT)
+#define PADCFG0_GPIORXDIS           BIT(9)
+#define PADCFG0_GPIOTXDIS           BIT(8)
+#define PADCFG0_GPIORXSTATE         BIT(1)
+#define PADCFG0_GPIOTXSTATE         BIT(0)
+
+#define PADCFG1                     0x004
+#define PADCFG1_TERM_UP             BIT(13)
+#define PADCFG1_TERM_SHIFT          10
+#define PADCFG1_TERM_MASK           (7 << PADCFG1_TERM_SHIFT)
+#define PADCFG1_TERM_20K            4
+#define PADCFG1_TERM_2K             3
+#define PADCFG1_TERM_5K             2
+#define PADCFG1_TERM_1K             1
+
+#define PADCFG2                     0x008
+#define PADCFG2_DEBEN               BIT(0)
+#define PADCFG2_DEBOUNCE_SHIFT      1
+#define PADCFG2_DEBOUNCE_MASK       GENMASK(4, 1)
+
+#define DEBOUNCE_PERIOD             31250 /* ns */
+
+/**
+ * Register access backend. The core driver normally talks to the hardware
+ * through plain loads and stores; once a backend is installed every access
+ * goes through it instead.
+ */
+class VoodooGPIORegisterBackend {
+ public:
+    virtual ~VoodooGPIORegisterBackend() {}
+
+    virtual uint32_t read32(uintptr_t addr) = 0;
+    virtual void write32(uint32_t value, uintptr_t addr) = 0;
+};
+
+#endif /* VoodooGPIORegisters_h */
@@ -0,0 +1,234 @@
+//
+//  VoodooGPIOReplay.cpp
+//  VoodooGPIO
+//
+
+#include "VoodooGPIOReplay.hpp"
+
+#ifdef VOODOOGPIO_BENCHMARK
+
+#include "VoodooGPIOBenchmark.hpp"
+#include "Simulation/VoodooGPIOTraceReplay.hpp"
+
+static bool intel_replay_get(OSDictionary *dict, const char *key, UInt32 *value) {
+    OSNumber *num = OSDynamicCast(OSNumber, dict->getObject(key));
+    if (!num)
+        return false;
+    *value = num->unsigned32BitValue();
+    return true;
+}
+
+static void intel_replay_set(OSDictionary *dict, const char *key, UInt64 value) {
+    OSNumber *num = OSNumber::withNumber((unsigned long long)value, 64);
+    if (num) {
+        dict->setObject(key, num);
+        num->release();
+    }
+}
+
+/**
+ * Turn a step dictionary into @step.
+ *
+ * @return false if the step is malformed.
+ */
+bool VoodooGPIOReplay::parseStep(OSDictionary *dict, struct intel_replay_step *step) {
+    OSString *op = OSDynamicCast(OSString, dict->getObject("Op"));
+    OSBoolean *flag;
+
+    if (!op)
+        return false;
+
+    bzero(step, sizeof(*step));
+    step->op = VoodooGPIOTraceReplay::parseOp(op->getCStringNoCopy());
+
+    switch (step->op) {
+        case kReplayOpRegister:
+            flag = OSDynamicCast(OSBoolean, dict->getObject("Filter"));
+            step->flag = flag && flag->isTrue();
+            step->has_type = intel_replay_get(dict, "Type", &step->type);
+            return intel_replay_get(dict, "Pin", &step->pin);
+        case kReplayOpUnregister:
+        case kReplayOpEnable:
+        case kReplayOpDisable:
+            return intel_replay_get(dict, "Pin", &step->pin);
+        case kReplayOpLevel:
+            flag = OSDynamicCast(OSBoolean, dict->getObject("Asserted"));
+            if (!flag)
+                return false;
+            step->flag = flag->isTrue();
+            /* Fall through */
+        case kReplayOpRaise:
+            return intel_replay_get(dict, "Community", &step->community) && intel_replay_get(dict, "Reg", &step->reg) &&
+                   intel_replay_get(dict, "Bits", &step->value);
+        case kReplayOpRead:
+        case kReplayOpWrite:
+            return intel_replay_get(dict, "Community", &step->community) &&
+                   intel_replay_get(dict, "Offset", &step->offset) && intel_replay_get(dict, "Value", &step->value);
+        case kReplayOpDelay:
+            return intel_replay_get(dict, "MS", &step->value);
+        case kReplayOpInterrupt:
+        case kReplayOpSleep:
+        case kReplayOpWake:
+            return true;
+        default:
+            return false;
+    }
+}
+
+/**
+ * Compare the simulated registers with @expected and publish the values
+ * found as "Registers" in @result, in the same format, so that the
+ * expectations of a new trace can be recorded from a run.
+ *
+ * @return false if a register differs or an entry is malformed.
+ */
+bool VoodooGPIOReplay::checkRegisters(VoodooGPIOTraceReplay *replay, OSArray *expected, OSDictionary *result) {
+    bool match = true;
+
+    if (!expected)
+        return true;
+
+    OSArray *found = OSArray::withCapacity(expected->getCount() ? expected->getCount() : 1);
+    if (!found)
+        return false;
+
+    for (unsigned i = 0; i < expected->getCount(); i++) {
+        OSDictionary *want = OSDynamicCast(OSDictionary, expected->getObject(i));
+        UInt32 community, offset, value;
+
+        if (!want || !intel_replay_get(want, "Community", &community) || !intel_replay_get(want, "Offset", &offset) ||
+            !intel_replay_get(want, "Value", &value)) {
+            match = false;
+            continue;
+        }
+
+        UInt32 got = replay->readRegister(community, offset);
+        if (got != value)
+            match = false;
+
+        OSDictionary *entry = OSDictionary::withCapacity(3);
+        if (entry) {
+            intel_replay_set(entry, "Community", community);
+            intel_replay_set(entry, "Offset", offset);
+            intel_replay_set(entry, "Value", got);
+            found->setObject(entry);
+            entry->release();
+        }
+    }
+
+    result->setObject("Registers", found);
+    found->release();
+    return match;
+}
+
+/**
+ * Replay @trace and compare the outcome with its expectations.
+ *
+ * @return Handler calls in order, register access counts and, if the trace
+ *         has expectations, whether they were met. %NULL if the trace is
+ *         malformed or names an unknown platform.
+ */
+OSDictionary *VoodooGPIOReplay::run(OSDictionary *trace) {
+    OSString *platform = OSDynamicCast(OSString, trace->getObject("Platform"));
+    OSArray *steps = OSDynamicCast(OSArray, trace->getObject("Steps"));
+    const struct intel_pinctrl_soc_data *soc;
+    VoodooGPIOTraceReplay replay;
+    OSDictionary *result = NULL;
+    OSArray *calls = NULL;
+    UInt32 revid, storm_rate = 0, counter_rate = 0, backoff_ms = 0;
+    UInt64 start, ns;
+
+    if (!platform || !steps)
+        return NULL;
+
+    soc = VoodooGPIOBenchmark::findPlatform(platform->getCStringNoCopy(), &revid);
+    if (!soc)
+        return NULL;
+
+    /* The same limits, and the same keys, as the driver personality */
+    intel_replay_get(trace, kStormRateKey, &storm_rate);
+    intel_replay_get(trace, kCounterStormRateKey, &counter_rate);
+    intel_replay_get(trace, kStormBackoffKey, &backoff_ms);
+
+    if (!replay.start(soc, revid, storm_rate, counter_rate, backoff_ms))
+        return NULL;
+
+    start = mach_absolute_time();
+    for (unsigned i = 0; i < steps->getCount(); i++) {
+        OSDictionary *dict = OSDynamicCast(OSDictionary, steps->getObject(i));
+        struct intel_replay_step step;
+
+        if (!dict || !parseStep(dict, &step) || !replay.runStep(&step)) {
+            IOLog("VoodooGPIOReplay::Malformed replay step %u\n", i);
+            return NULL;
+        }
+    }
+    absolutetime_to_nanoseconds(mach_absolute_time() - start, &ns);
+
+    result = OSDictionary::withCapacity(8);
+    calls = OSArray::withCapacity(replay.ncalls ? (unsigned)replay.ncalls : 1);
+    if (!result || !calls) {
+        OSSafeReleaseNULL(calls);
+        OSSafeReleaseNULL(result);
+        return NULL;
+    }
+
+    for (size_t i = 0; i < replay.ncalls; i++) {
+        OSNumber *num = OSNumber::withNumber(replay.calls[i], 32);
+        if (num) {
+            calls->setObject(num);
+            num->release();
+        }
+    }
+
+    result->setObject("Handlers", calls);
+    intel_replay_set(result, "MMIOReads", replay.pch.reads);
+    intel_replay_set(result, "MMIOWrites", replay.pch.writes);
+    intel_replay_set(result, "Interrupts", replay.pctl.stats.interrupts);
+    intel_replay_set(result, "StormEvents", replay.pctl.stats.storm_events);
+    intel_replay_set(result, "ElapsedNS", ns);
+
+    {
+        OSArray *expected = OSDynamicCast(OSArray, trace->getObject("ExpectHandlers"));
+        const char *mismatch = NULL;
+        UInt32 value;
+
+        if (expected) {
+            if (expected->getCount() != replay.ncalls) {
+                mismatch = "Handlers";
+            } else {
+                for (unsigned i = 0; i < replay.ncalls; i++) {
+                    OSNumber *want = OSDynamicCast(OSNumber, expected->getObject(i));
+                    if (!want || want->unsigned32BitValue() != replay.calls[i]) {
+                        mismatch = "Handlers";
+                        break;
+                    }
+                }
+            }
+        }
+        if (!mismatch && intel_replay_get(trace, "ExpectMMIOReads", &value) && value != replay.pch.reads)
+            mismatch = "MMIOReads";
+        if (!mismatch && intel_replay_get(trace, "ExpectMMIOWrites", &value) && value != replay.pch.writes)
+            mismatch = "MMIOWrites";
+        if (!mismatch && intel_replay_get(trace, "ExpectStormEvents", &value) &&
+            value != replay.pctl.stats.storm_events)
+            mismatch = "StormEvents";
+        if (!checkRegisters(&replay, OSDynamicCast(OSArray, trace->getObject("ExpectRegisters")), result) &&
+            !mismatch)
+            mismatch = "Registers";
+
+        result->setObject("Passed", mismatch ? kOSBooleanFalse : kOSBooleanTrue);
+        if (mismatch) {
+            OSString *str = OSString::withCString(mismatch);
+            if (str) {
+                result->setObject("Mismatch", str);
+                str->release();
+            }
+        }
+    }
+
+    calls->release();
+    return result;
+}
+
+#endif /* VOODOOGPIO_BENCHMARK */
@@ -0,0 +1,72 @@
+//
+//  VoodooGPIOReplay.hpp
+//  VoodooGPIO
+//
+
+#ifndef VoodooGPIOReplay_h
+#define VoodooGPIOReplay_h
+
+#ifdef VOODOOGPIO_BENCHMARK
+
+#include "VoodooGPIO.hpp"
+
+class VoodooGPIOTraceReplay;
+struct intel_replay_step;
+
+#define kReplayKey          "ReplayTrace"
+#define kReplayResultKey    "ReplayResult"
+
+/**
+ * Register trace replay (debug builds only).
+ *
+ * A trace is a dictionary:
+ *   Platform          soc name of the platform table, e.g. "CannonLake-LP"
+ *   Steps             array of step dictionaries, run in order
+ *   StormRate, CounterStormRate, StormBackoffMS
+ *                     optional storm limits, as in the driver personality
+ *   ExpectHandlers    optional array of GPIO pins, the expected handler calls
+ *   ExpectMMIOReads   optional expected number of register reads
+ *   ExpectMMIOWrites  optional expected number of register writes
+ *   ExpectStormEvents optional expected number of pins throttled
+ *   ExpectRegisters   optional array of Community, Offset, Value
+ *                     dictionaries, the expected register values once
+ *                     every step ran
+ *
+ * Each step has an "Op" and its arguments:
+ *   Register    Pin, Type (IRQ_TYPE_*), Filter (optional boolean)
+ *   Unregister  Pin
+ *   Enable      Pin
+ *   Disable     Pin
+ *   Raise       Community, Reg, Bits: latch GPI_IS bits
+ *   Level       Community, Reg, Bits, Asserted: drive level sources
+ *   Interrupt   run the filter routine and, if it asks to, the handler
+ *   Sleep, Wake setPowerState transitions
+ *   Read        Community, Offset, Value: the register returned Value. A
+ *               GPI_IS value is latched and raises the controller interrupt
+ *               if an unmasked pin is in it, a PADBAR value gives where
+ *               the PADCFG offsets of the trace start, anything else is
+ *               set in the simulated register.
+ *   Write       Community, Offset, Value: host register write
+ *   Delay       MS: let time pass, e.g. for throttled pins to come back
+ *
+ * Read and Write steps are what the MMIOTrace property of a debug build
+ * holds, PADBAR of every community first, so a dumped trace can be used
+ * as steps unchanged. Offsets are from the community registers.
+ *
+ * The trace runs through the core on a simulated PCH; see
+ * VoodooGPIOTraceReplay. Storm throttling is on, with the driver defaults
+ * unless the trace sets its own limits. Recorded traces with their
+ * expectations are kept in Tests/Fixtures and replayed by ctest.
+ */
+class VoodooGPIOReplay {
+ public:
+    static OSDictionary *run(OSDictionary *trace);
+
+ private:
+    static bool parseStep(OSDictionary *dict, struct intel_replay_step *step);
+    static bool checkRegisters(VoodooGPIOTraceReplay *replay, OSArray *expected, OSDictionary *result);
+};
+
+#endif /* VOODOOGPIO_BENCHMARK */
+
+#endif /* VoodooGPIOReplay_h */
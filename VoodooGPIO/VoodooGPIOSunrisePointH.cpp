@@ -8,19 +8,28 @@
 
 #include "VoodooGPIOSunrisePointH.hpp"
 
+#ifndef VOODOOGPIO_HOST
 OSDefineMetaClassAndStructors(VoodooGPIOSunrisePointH, VoodooGPIO);
+#endif
 
+const struct intel_pinctrl_soc_data spth_soc_data = {
+    .name = "SunrisePoint-H",
+    .pins = spth_pins,
+    .npins = ARRAY_SIZE(spth_pins),
+    .groups = spth_groups,
+    .ngroups = ARRAY_SIZE(spth_groups),
+    .functions = spth_functions,
+    .nfunctions = ARRAY_SIZE(spth_functions),
+    .communities = spth_communities,
+    .ncommunities = ARRAY_SIZE(spth_communities),
+};
+
+#ifndef VOODOOGPIO_HOST
 bool VoodooGPIOSunrisePointH::start(IOService *provider) {
-    this->pins = spth_pins;
-    this->npins = ARRAY_SIZE(spth_pins);
-    this->groups = spth_groups;
-    this->ngroups = ARRAY_SIZE(spth_groups);
-    this->functions = spth_functions;
-    this->nfunctions = ARRAY_SIZE(spth_functions);
-    this->communities = spth_communities;
-    this->ncommunities = ARRAY_SIZE(spth_communities);
+    intel_pinctrl_set_soc_data(&spth_soc_data);
 
     IOLog("%s::Loading GPIO Data for SunrisePoint-H\n", getName());
 
     return VoodooGPIO::start(provider);
 }
+#endif
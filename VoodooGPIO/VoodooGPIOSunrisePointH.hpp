@@ -6,7 +6,11 @@
 //  Copyright © 2017 CoolStar. All rights reserved.
 //
 
+#ifdef VOODOOGPIO_HOST
+#include "VoodooGPIOCore.hpp"
+#else
 #include "VoodooGPIO.hpp"
+#endif
 
 #ifndef VoodooGPIOSunrisePointH_h
 #define VoodooGPIOSunrisePointH_h
@@ -23,9 +27,9 @@
     .padcfglock_offset = SPT_PADCFGLOCK,    \
     .hostown_offset = SPT_HOSTSW_OWN,       \
     .ie_offset = SPT_GPI_IE,                \
+    .pin_base = (s),                        \
     .gpp_size = 24,                         \
     .gpp_num_padown_regs = 4,               \
-    .pin_base = (s),                        \
     .npins = ((e) - (s) + 1),               \
 }
 
@@ -279,10 +283,14 @@ static struct intel_community spth_communities[] = {
     SPT_COMMUNITY(2, 181, 191),
 };
 
+extern const struct intel_pinctrl_soc_data spth_soc_data;
+
+#ifndef VOODOOGPIO_HOST
 class VoodooGPIOSunrisePointH : public VoodooGPIO {
     OSDeclareDefaultStructors(VoodooGPIOSunrisePointH);
 
     bool start(IOService *provider) override;
 };
+#endif
 
 #endif /* VoodooGPIOSunrisePointH_h */
@@ -8,19 +8,28 @@
 
 #include "VoodooGPIOSunrisePointLP.hpp"
 
+#ifndef VOODOOGPIO_HOST
 OSDefineMetaClassAndStructors(VoodooGPIOSunrisePointLP, VoodooGPIO);
+#endif
 
+const struct intel_pinctrl_soc_data sptlp_soc_data = {
+    .name = "SunrisePoint-LP",
+    .pins = sptlp_pins,
+    .npins = ARRAY_SIZE(sptlp_pins),
+    .groups = sptlp_groups,
+    .ngroups = ARRAY_SIZE(sptlp_groups),
+    .functions = sptlp_functions,
+    .nfunctions = ARRAY_SIZE(sptlp_functions),
+    .communities = sptlp_communities,
+    .ncommunities = ARRAY_SIZE(sptlp_communities),
+};
+
+#ifndef VOODOOGPIO_HOST
 bool VoodooGPIOSunrisePointLP::start(IOService *provider) {
-    this->pins = sptlp_pins;
-    this->npins = ARRAY_SIZE(sptlp_pins);
-    this->groups = sptlp_groups;
-    this->ngroups = ARRAY_SIZE(sptlp_groups);
-    this->functions = sptlp_functions;
-    this->nfunctions = ARRAY_SIZE(sptlp_functions);
-    this->communities = sptlp_communities;
-    this->ncommunities = ARRAY_SIZE(sptlp_communities);
+    intel_pinctrl_set_soc_data(&sptlp_soc_data);
 
     IOLog("%s::Loading GPIO Data for SunrisePoint-LP\n", getName());
 
     return VoodooGPIO::start(provider);
 }
+#endif